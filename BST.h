@@ -1,516 +1,1423 @@
 #ifndef BST_H_
 #define BST_H_
 
+#include <iterator>
 #include <memory>
-#include "node.h"
-#include "map.h"
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "augment.h"
+#include "compare.h"
+#include "frozenBST.h"
+#include "nodeAllocator.h"
+#include "taskPool.h"
+#include "valueStorage.h"
 
-template <class keyT, class dataT>
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy>
+struct TreeNode : AugmentSlot<Augment, dataT> {
+    typedef typename NodePolicy::template Link<TreeNode> Link;
+
+    typedef typename ValuePolicy::template Stored<dataT> StoredT;
+
+    keyT key;
+    StoredT data;
+    Link left;
+    Link right;
+    int height;
+    int count;
+
+    TreeNode(const keyT& key, const StoredT& data) :
+        AugmentSlot<Augment, dataT>(ValuePolicy::Address(data)), key(key), data(data), left(nullptr), right(nullptr), height(0), count(1) {}
+    TreeNode(const keyT& key, StoredT&& data) :
+        AugmentSlot<Augment, dataT>(ValuePolicy::Address(data)), key(key), data(std::move(data)), left(nullptr), right(nullptr), height(0), count(1) {}
+    explicit TreeNode(int height) :
+        AugmentSlot<Augment, dataT>(nullptr), key(), data(), left(nullptr), right(nullptr), height(height), count(1) {}
+};
+
+template <class keyT, class dataT, class NodePolicy = SharedNodePolicy, class Augment = NoAugment,
+          class ValuePolicy = SharedValuePolicy, class Compare = DefaultCompare>
 class BST {
+    public:
+        typedef TreeNode<keyT, dataT, NodePolicy, Augment, ValuePolicy> NodeT;
+        typedef typename NodeT::Link NodePtr;
+        typedef typename NodeT::StoredT StoredT;
+        typedef typename ValuePolicy::template Handle<dataT> HandleT;
+        typedef typename ValuePolicy::template Taken<dataT> TakenT;
+        class const_iterator;
+
     private:
-        static std::shared_ptr<Node<keyT, dataT>> InsertAux(std::shared_ptr<Node<keyT, dataT>> root, 
-                                                            std::shared_ptr<Node<keyT, dataT>> toInsert); 
-        static int GetBF(std::shared_ptr<Node<keyT, dataT>> node);
-        static int GetHeight(std::shared_ptr<Node<keyT, dataT>> node);
-        static std::shared_ptr<Node<keyT, dataT>> LLRotation(std::shared_ptr<Node<keyT, dataT>>& root);
-        static std::shared_ptr<Node<keyT, dataT>> LRRotation(std::shared_ptr<Node<keyT, dataT>>& root);
-        static std::shared_ptr<Node<keyT, dataT>> RLRotation(std::shared_ptr<Node<keyT, dataT>>& root);
-        static std::shared_ptr<Node<keyT, dataT>> RRRotation(std::shared_ptr<Node<keyT, dataT>>& root);
-        static std::shared_ptr<Node<keyT, dataT>> RemoveAux(std::shared_ptr<Node<keyT, dataT>>& root, const keyT& key);
-        static std::shared_ptr<Node<keyT, dataT>> FindNextInOrder(std::shared_ptr<Node<keyT, dataT>> root);
-        static void SaveInOrder(const std::shared_ptr<Node<keyT, dataT>> root, std::shared_ptr<keyT> *keyArr, std::shared_ptr<dataT> *dataArr, int *i);
-        static void MergeArr(std::shared_ptr<keyT> *keyArr1, std::shared_ptr<keyT> *keyArr2, std::shared_ptr<dataT> *dataArr1,
-                                std::shared_ptr<dataT> *dataArr2, std::shared_ptr<keyT> *keyMergedArr, std::shared_ptr<dataT> *dataMergedArr,
-                                int size1, int size2);
-        static void InsertElements(std::shared_ptr<Node<keyT, dataT>> root, std::shared_ptr<keyT> *keyArr,
-                                   std::shared_ptr<dataT> *dataArr, int size, int *i);
-        static BST<keyT, dataT> BuildEmptyTree(int n);
-        static void removeRightLeafs(std::shared_ptr<Node<keyT, dataT>> root, int *removecount, int leafPathLen, int currPathLen);
-        static int FindHeightOfComplete(int num);
-        static std::shared_ptr<Node<keyT, dataT>> BuildCompleteTree(int h);
-        static int ComputeSizeOfComplete(int height);
+        typedef typename NodePolicy::template Pool<NodeT> Pool;
+        typedef std::integral_constant<bool, !std::is_same<Augment, NoAugment>::value> Augmented;
+
+        Pool pool;
+
+        static const int MAX_DEPTH = 64;
+        static const int PARALLEL_GRAIN = 2048;
+
+        template <class K>
+        const NodeT* FindNode(const K& target) const;
+        template <class K>
+        const_iterator LowerBound(const K& key) const;
+        template <class K>
+        const_iterator UpperBound(const K& key) const;
+        NodePtr* Descend(const keyT& key, NodePtr** path, int* depth);
+        NodePtr* DescendFromHint(const const_iterator& hint, const keyT& key, NodePtr** path, int* depth);
+        static void RebalancePath(NodePtr** path, int depth);
+        template <class Value>
+        void InsertValue(const keyT& key, Value&& data);
+        static void Rebalance(NodePtr& root);
+        static NodePtr JoinAux(NodePtr left, NodePtr pivot, NodePtr right);
+        static void SplitAux(NodePtr root, const keyT& key, NodePtr& left, NodePtr& found, NodePtr& right);
+        static NodePtr SplitLast(NodePtr root, NodePtr& last);
+        static NodePtr SplitFirst(NodePtr root, NodePtr& first);
+        static NodePtr Join2(NodePtr left, NodePtr right);
+        static bool Fork(TaskPool* tasks, const NodePtr& tree1, const NodePtr& tree2);
+        static void DropNode(NodePtr& node, Pool& nodes);
+        static NodePtr UnionAux(NodePtr tree1, NodePtr tree2, Pool& nodes, TaskPool* tasks);
+        static NodePtr IntersectionAux(NodePtr tree1, NodePtr tree2, Pool& nodes, TaskPool* tasks);
+        static NodePtr DifferenceAux(NodePtr tree1, NodePtr tree2, Pool& nodes, TaskPool* tasks);
+        static BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare> TakeBoth(BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>& tree1, BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>& tree2);
+        static int GetBF(const NodePtr& node);
+        static int GetHeight(const NodePtr& node);
+        static int GetCount(const NodePtr& node);
+        static void UpdateNode(const NodePtr& node);
+        static void Summarize(const NodePtr&, std::false_type) {}
+        static void Summarize(const NodePtr& node, std::true_type);
+        static typename Augment::type GetSummary(const NodePtr& node);
+        static typename Augment::type Lift(const StoredT& data);
+        int CountLess(const keyT& key, bool inclusive) const;
+        static NodePtr LLRotation(NodePtr& root);
+        static NodePtr LRRotation(NodePtr& root);
+        static NodePtr RLRotation(NodePtr& root);
+        static NodePtr RRRotation(NodePtr& root);
+        static NodePtr BuildFromVine(NodePtr& head, int n);
+        template <class Iterator>
+        NodePtr BuildSorted(Iterator begin, Iterator end, int* n);
+        template <class Iterator>
+        void ReserveFor(Iterator begin, Iterator end, std::forward_iterator_tag);
+        template <class Iterator>
+        void ReserveFor(Iterator, Iterator, std::input_iterator_tag) {}
         static int IntMax(int a, int b);
 
     public:
-        std::shared_ptr<Node<keyT, dataT>> root;
+        NodePtr root;
         int size;
 
         BST() : root(nullptr), size(0) {}
-        BST(std::shared_ptr<Node<keyT, dataT>> root, int size) : root(root), size(size) {}
-        ~BST() = default;
-        std::shared_ptr<dataT> Get(const keyT& target);
-        bool Find(const keyT& target);
-        void Insert(const keyT key, std::shared_ptr<dataT>& data);
+        BST(NodePtr root, int size) : root(root), size(size) {}
+        BST(const BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>& copy) : root(pool.Copy(copy.root)), size(copy.size) {}
+        BST(BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& other);
+        ~BST();
+        HandleT Get(const keyT& target) const;
+        bool Find(const keyT& target) const;
+        //Lookups by any type Compare can order against keyT; only offered when Compare is transparent.
+        template <class K, class C = Compare, class = typename C::is_transparent>
+        HandleT Get(const K& target) const;
+        template <class K, class C = Compare, class = typename C::is_transparent>
+        bool Find(const K& target) const;
+        void Insert(const keyT key, StoredT& data);
+        void Insert(const keyT key, StoredT&& data);
         void Remove(const keyT& key);
-        static BST<keyT, dataT> Merge(const BST<keyT, dataT>& tree1, const BST<keyT, dataT>& tree2);
+        template <class... Args>
+        std::pair<HandleT, bool> TryEmplace(const keyT& key, Args&&... args);
+        std::pair<HandleT, bool> InsertOrAssign(const keyT& key, StoredT data);
+        std::pair<HandleT, bool> Insert(const_iterator hint, const keyT& key, StoredT data);
+        template <class Iterator>
+        void InsertSorted(Iterator begin, Iterator end);
+        TakenT Extract(const keyT& key);
+        int Rank(const keyT& key) const;
+        const keyT& Select(int i) const;
+        int CountRange(const keyT& lo, const keyT& hi) const;
+        typename Augment::type Aggregate(const keyT& lo, const keyT& hi) const;
+
+        const_iterator begin() const;
+        const_iterator end() const;
+        const_iterator lower_bound(const keyT& key) const;
+        const_iterator upper_bound(const keyT& key) const;
+        std::pair<const_iterator, const_iterator> equal_range(const keyT& key) const;
+        template <class K, class C = Compare, class = typename C::is_transparent>
+        const_iterator lower_bound(const K& key) const;
+        template <class K, class C = Compare, class = typename C::is_transparent>
+        const_iterator upper_bound(const K& key) const;
+        template <class K, class C = Compare, class = typename C::is_transparent>
+        std::pair<const_iterator, const_iterator> equal_range(const K& key) const;
+        template <class Function>
+        void ForEachInRange(const keyT& lo, const keyT& hi, Function fn) const;
+        FrozenBST<keyT, dataT, ValuePolicy, Compare> Freeze() const;
+        static BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare> Merge(const BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>& tree1, const BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>& tree2);
+        static BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare> Merge(BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& tree1, BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& tree2);
+        static BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare> Join(BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& left, const keyT& key,
+                                                 StoredT data, BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& right);
+        static TakenT Split(BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& tree, const keyT& key,
+                                            BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>& left, BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>& right);
+        static BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare> Union(BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& tree1, BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& tree2,
+                                                  TaskPool* tasks = nullptr);
+        static BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare> Intersection(BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& tree1, BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& tree2,
+                                                         TaskPool* tasks = nullptr);
+        static BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare> Difference(BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& tree1, BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& tree2,
+                                                       TaskPool* tasks = nullptr);
         dataT& GetMax();
         dataT& GetMin();
-        static Map* MergeToArr(const BST<keyT, dataT>& tree1, const BST<keyT, dataT>& tree2);
-        static BST<keyT, dataT> ArrToBST(Map* map, int size, int oldSize);  
-        BST<keyT, dataT>& operator=(const BST<keyT, dataT>& copy);   
+        template <class Iterator>
+        static BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare> FromSorted(Iterator begin, Iterator end);
+        BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>& operator=(const BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>& copy);   
+        BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>& operator=(BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& other);
 };
 
-template <class keyT, class dataT>
-int BST<keyT, dataT>::IntMax(int a, int b)
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::BST(BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& other) :
+    pool(std::move(other.pool)), root(std::move(other.root)), size(other.size)
+{
+    other.root = nullptr;
+    other.size = 0;
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::~BST()
+{
+    pool.Clear(this->root);
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+int BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::IntMax(int a, int b)
 {
     return a > b ? a : b;
 }
 
-template <class keyT, class dataT>
-BST<keyT, dataT>& BST<keyT, dataT>::operator=(const BST<keyT, dataT>& copy)
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>& BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::operator=(const BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>& copy)
 {
-    this->root = copy.root;
+    if (this == &copy)
+        return *this;
+    pool.Clear(this->root);
+    this->root = pool.Copy(copy.root);
     this->size = copy.size;
     return *this;
-}     
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>& BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::operator=(BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& other)
+{
+    if (this == &other)
+        return *this;
+    pool.Clear(this->root);
+    pool = std::move(other.pool);
+    this->root = std::move(other.root);
+    this->size = other.size;
+    other.root = nullptr;
+    other.size = 0;
+    return *this;
+}
 
 
-template <class keyT, class dataT>
-std::shared_ptr<dataT> BST<keyT, dataT>::Get(const keyT& target)
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+template <class K>
+const typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::NodeT* BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::FindNode(const K& target) const
 {
-    std::shared_ptr<Node<keyT, dataT>> curr = root;
+    const NodeT* curr = Pool::Raw(root);
     while(curr != nullptr)
     {
-        if(curr->key == target)
-            return curr->data;
+        int order = Compare::Order(curr->key, target);
+        if(order == 0)
+            return curr;
         
-        if(curr->key < target)
-            curr = curr->right;
+        if(order < 0)
+            curr = Pool::Raw(curr->right);
         else
-            curr = curr->left;
+            curr = Pool::Raw(curr->left);
     }
     return nullptr;
 }
 
-template <class keyT, class dataT>
-bool BST<keyT, dataT>::Find(const keyT& target)
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::HandleT BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Get(const keyT& target) const
+{
+    const NodeT* node = this->FindNode(target);
+    if(node == nullptr)
+        return nullptr;
+    return ValuePolicy::Ref(node->data);
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+bool BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Find(const keyT& target) const
+{
+    return this->FindNode(target) != nullptr;
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+template <class K, class C, class>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::HandleT BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Get(const K& target) const
+{
+    const NodeT* node = this->FindNode(target);
+    if(node == nullptr)
+        return nullptr;
+    return ValuePolicy::Ref(node->data);
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+template <class K, class C, class>
+bool BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Find(const K& target) const
+{
+    return this->FindNode(target) != nullptr;
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::NodePtr* BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Descend(const keyT& key, NodePtr** path, int* depth)
+{
+    NodePtr* link = &this->root;
+    *depth = 0;
+    while(*link != nullptr)
+    {
+        NodeT* curr = Pool::Raw(*link);
+        int order = Compare::Order(curr->key, key);
+        if(order == 0)
+            return link;
+
+        path[(*depth)++] = link;
+        if(order < 0)
+            link = &curr->right;
+        else
+            link = &curr->left;
+    }
+    return link;
+}
+
+//Once a subtree keeps its height, nothing above it can need a rotation, only a new count.
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+void BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::RebalancePath(NodePtr** path, int depth)
 {
-    if(this->Get(target) == nullptr)
-        return false;
-    return true;
+    while (depth > 0) {
+        NodePtr& node = *path[--depth];
+        int height = node->height;
+        BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Rebalance(node);
+        if (node->height == height)
+            break;
+    }
+    while (depth > 0) {
+        const NodePtr& node = *path[--depth];
+        node->count = GetCount(node->left) + GetCount(node->right) + 1;
+        Summarize(node, Augmented());
+    }
 }
 
-template <class keyT, class dataT>
-void BST<keyT, dataT>::Insert(const keyT key, std::shared_ptr<dataT>& dataPtr)
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+template <class Value>
+void BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::InsertValue(const keyT& key, Value&& data)
 {
-    if(this->Find(key))
+    NodePtr* path[MAX_DEPTH];
+    int depth;
+    NodePtr* link = this->Descend(key, path, &depth);
+    if(*link != nullptr)
         return;
-    
-    std::shared_ptr<dataT> copyData = std::shared_ptr<dataT>(dataPtr); 
-    auto toInsert = std::shared_ptr<Node<keyT, dataT>>(new Node<keyT, dataT>(key,copyData));
 
-    this->root = BST<keyT, dataT>::InsertAux(this->root, toInsert);
+    *link = pool.Create(key, std::forward<Value>(data));
+    BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::RebalancePath(path, depth);
+    this->size++;
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+void BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Insert(const keyT key, StoredT& data)
+{
+    this->InsertValue(key, data);
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+void BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Insert(const keyT key, StoredT&& data)
+{
+    this->InsertValue(key, std::move(data));
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+template <class... Args>
+std::pair<typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::HandleT, bool> BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::TryEmplace(const keyT& key, Args&&... args)
+{
+    NodePtr* path[MAX_DEPTH];
+    int depth;
+    NodePtr* link = this->Descend(key, path, &depth);
+    if(*link != nullptr)
+        return std::make_pair(ValuePolicy::Ref((*link)->data), false);
+
+    *link = pool.Create(key, ValuePolicy::template Make<dataT>(std::forward<Args>(args)...));
+    NodeT* node = Pool::Raw(*link);
+    BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::RebalancePath(path, depth);
+    this->size++;
+    return std::make_pair(ValuePolicy::Ref(node->data), true);
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+std::pair<typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::HandleT, bool> BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::InsertOrAssign(const keyT& key, StoredT data)
+{
+    NodePtr* path[MAX_DEPTH];
+    int depth;
+    NodePtr* link = this->Descend(key, path, &depth);
+    if(*link != nullptr) {
+        NodeT* node = Pool::Raw(*link);
+        node->data = std::move(data);
+        if (Augmented::value) {
+            UpdateNode(*link);
+            BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::RebalancePath(path, depth);
+        }
+        return std::make_pair(ValuePolicy::Ref(node->data), false);
+    }
+
+    *link = pool.Create(key, std::move(data));
+    NodeT* node = Pool::Raw(*link);
+    BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::RebalancePath(path, depth);
     this->size++;
+    return std::make_pair(ValuePolicy::Ref(node->data), true);
+}
+
+/*
+* Finds where key goes when it belongs right before hint, without comparing
+* against anything but the hint and its predecessor: the path to hint is
+* copied from the iterator, then the walk continues down the right spine of
+* hint's left subtree. end() as the hint makes this an append after the
+* maximum. Returns nullptr when key does not belong there or the hint no
+* longer matches the tree.
+*/
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::NodePtr* BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::DescendFromHint(const const_iterator& hint,
+                                                                                                               const keyT& key, NodePtr** path, int* depth)
+{
+    NodePtr* link = &this->root;
+    NodePtr* prevLink = nullptr;
+    *depth = 0;
+    for (int i = 0; i < hint.depth; i++) {
+        NodeT* curr = Pool::Raw(*link);
+        if (curr != hint.path[i])
+            return nullptr;
+        if (i + 1 == hint.depth)
+            break;
+
+        path[(*depth)++] = link;
+        if (Pool::Raw(curr->left) == hint.path[i + 1])
+            link = &curr->left;
+        else {
+            prevLink = link;
+            link = &curr->right;
+        }
+    }
+
+    if (hint.depth > 0) {
+        int order = Compare::Order((*link)->key, key);
+        if (order == 0)
+            return link;
+        if (order < 0)
+            return nullptr;
+        path[(*depth)++] = link;
+        link = &(*link)->left;
+    }
+    while (*link != nullptr) {
+        path[(*depth)++] = link;
+        prevLink = link;
+        link = &(*link)->right;
+    }
+
+    if (prevLink != nullptr) {
+        int order = Compare::Order((*prevLink)->key, key);
+        if (order == 0)
+            return prevLink;
+        if (order > 0)
+            return nullptr;
+    }
+    return link;
 }
 
-template <class keyT, class dataT>
-int BST<keyT, dataT>::GetHeight(std::shared_ptr<Node<keyT, dataT>> node)
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+std::pair<typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::HandleT, bool> BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Insert(const_iterator hint, const keyT& key, StoredT data)
+{
+    NodePtr* path[MAX_DEPTH];
+    int depth;
+    NodePtr* link = this->DescendFromHint(hint, key, path, &depth);
+    if (link == nullptr)
+        link = this->Descend(key, path, &depth);
+    if (*link != nullptr)
+        return std::make_pair(ValuePolicy::Ref((*link)->data), false);
+
+    *link = pool.Create(key, std::move(data));
+    NodeT* node = Pool::Raw(*link);
+    BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::RebalancePath(path, depth);
+    this->size++;
+    return std::make_pair(ValuePolicy::Ref(node->data), true);
+}
+
+/*
+* Adds a batch with strictly increasing keys; keys already in the tree keep their values.
+* The batch is built as one balanced tree, and only the part of it that does not
+* go past the largest key needs a union. The rest is joined on in O(log n), so
+* appending m keys costs O(m + log n) and every node is summarized once.
+*/
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+template <class Iterator>
+void BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::InsertSorted(Iterator begin, Iterator end)
+{
+    int n = 0;
+    NodePtr batch = this->BuildSorted(begin, end, &n);
+    NodePtr low = nullptr;
+    NodePtr duplicate = nullptr;
+    NodePtr high = nullptr;
+    if (this->root != nullptr && batch != nullptr) {
+        const NodeT* last = Pool::Raw(this->root);
+        while (last->right != nullptr)
+            last = Pool::Raw(last->right);
+        BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::SplitAux(std::move(batch), last->key, low, duplicate, high);
+    }
+    else
+        high = std::move(batch);
+
+    DropNode(duplicate, pool);
+    this->root = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::UnionAux(std::move(this->root), std::move(low), pool, nullptr);
+    if (high != nullptr) {
+        //Taking the pivot from the batch keeps the walk on the big tree to its right spine.
+        NodePtr first = nullptr;
+        NodePtr rest = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::SplitFirst(std::move(high), first);
+        this->root = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::JoinAux(std::move(this->root), std::move(first), std::move(rest));
+    }
+    this->size = GetCount(this->root);
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+int BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::GetHeight(const NodePtr& node)
 {
     if(node == nullptr)
         return -1;
     return node->height;
 }
 
-template <class keyT, class dataT>
-int BST<keyT, dataT>::GetBF(std::shared_ptr<Node<keyT, dataT>> node)
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+int BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::GetCount(const NodePtr& node)
+{
+    if(node == nullptr)
+        return 0;
+    return node->count;
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+void BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::UpdateNode(const NodePtr& node)
+{
+    node->height = IntMax(GetHeight(node->left), GetHeight(node->right)) + 1;
+    node->count = GetCount(node->left) + GetCount(node->right) + 1;
+    Summarize(node, Augmented());
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+void BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Summarize(const NodePtr& node, std::true_type)
+{
+    node->summary = Augment::Combine(Augment::Combine(GetSummary(node->left), Lift(node->data)), GetSummary(node->right));
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename Augment::type BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::GetSummary(const NodePtr& node)
+{
+    if(node == nullptr)
+        return Augment::Identity();
+    return node->summary;
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename Augment::type BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Lift(const StoredT& data)
+{
+    const dataT* value = ValuePolicy::Address(data);
+    if(value == nullptr)
+        return Augment::Identity();
+    return Augment::Lift(*value);
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+int BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::GetBF(const NodePtr& node)
 {
-    return BST<keyT, dataT>::GetHeight(node->left) - BST<keyT, dataT>::GetHeight(node->right);
+    return BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::GetHeight(node->left) - BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::GetHeight(node->right);
 }
 
-template <class keyT, class dataT>
-std::shared_ptr<Node<keyT, dataT>> BST<keyT, dataT>::LLRotation(std::shared_ptr<Node<keyT, dataT>>& root)
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::NodePtr BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::LLRotation(NodePtr& root)
 {
-    std::shared_ptr<Node<keyT, dataT>> B = root;
-    std::shared_ptr<Node<keyT, dataT>> A = B->left;
-    std::shared_ptr<Node<keyT, dataT>> AL = A->left;
-    std::shared_ptr<Node<keyT, dataT>> AR = A->right;
+    NodePtr B = std::move(root);
+    NodePtr A = std::move(B->left);
+
+    B->left = std::move(A->right);
+    UpdateNode(B);
+    A->right = std::move(B);
+    UpdateNode(A);
 
-    B->left = AR;
-    A->right = B;
-    
-    B->height = IntMax(GetHeight(B->left), GetHeight(B->right)) + 1;
-    A->height = IntMax(GetHeight(A->left), GetHeight(A->right)) + 1;   
-     
     return A;
 }
 
-template <class keyT, class dataT>
-std::shared_ptr<Node<keyT, dataT>> BST<keyT, dataT>::LRRotation(std::shared_ptr<Node<keyT, dataT>>& root)
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::NodePtr BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::LRRotation(NodePtr& root)
 {
-    std::shared_ptr<Node<keyT, dataT>> A = root->left;
-    std::shared_ptr<Node<keyT, dataT>> B = A->right;
-    std::shared_ptr<Node<keyT, dataT>> C = root;
-    std::shared_ptr<Node<keyT, dataT>> BL = B->left;
-    std::shared_ptr<Node<keyT, dataT>> BR = B->right;
+    NodePtr C = std::move(root);
+    NodePtr A = std::move(C->left);
+    NodePtr B = std::move(A->right);
+
+    C->left = std::move(B->right);
+    A->right = std::move(B->left);
 
-    C->left = BR;
-    A->right = BL;
-    B->left = A;
-    B->right = C;
+    UpdateNode(A);
+    UpdateNode(C);
+    B->left = std::move(A);
+    B->right = std::move(C);
+    UpdateNode(B);
 
-    A->height = IntMax(GetHeight(A->left), GetHeight(A->right)) + 1;
-    C->height = IntMax(GetHeight(C->left), GetHeight(C->right)) + 1;
-    B->height = IntMax(GetHeight(B->left), GetHeight(B->right)) + 1;
-    
     return B;
 }
 
-template <class keyT, class dataT>
-std::shared_ptr<Node<keyT, dataT>> BST<keyT, dataT>::RLRotation(std::shared_ptr<Node<keyT, dataT>>& root)
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::NodePtr BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::RLRotation(NodePtr& root)
 {
-    std::shared_ptr<Node<keyT, dataT>> A = root->right;
-    std::shared_ptr<Node<keyT, dataT>> B = A->left;
-    std::shared_ptr<Node<keyT, dataT>> C = root;
-    std::shared_ptr<Node<keyT, dataT>> BL = B->left;
-    std::shared_ptr<Node<keyT, dataT>> BR = B->right;
+    NodePtr C = std::move(root);
+    NodePtr A = std::move(C->right);
+    NodePtr B = std::move(A->left);
 
-    C->right = BL;
-    A->left = BR;
-    B->right = A;
-    B->left = C;
+    C->right = std::move(B->left);
+    A->left = std::move(B->right);
 
-    A->height = IntMax(GetHeight(A->left), GetHeight(A->right)) + 1;
-    C->height = IntMax(GetHeight(C->left), GetHeight(C->right)) + 1;
-    B->height = IntMax(GetHeight(B->left), GetHeight(B->right)) + 1;
+    UpdateNode(A);
+    UpdateNode(C);
+    B->right = std::move(A);
+    B->left = std::move(C);
+    UpdateNode(B);
 
     return B;
 }
 
-template <class keyT, class dataT>
-std::shared_ptr<Node<keyT, dataT>> BST<keyT, dataT>::RRRotation(std::shared_ptr<Node<keyT, dataT>>& root)
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::NodePtr BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::RRRotation(NodePtr& root)
 {
-    std::shared_ptr<Node<keyT, dataT>> B = root;
-    std::shared_ptr<Node<keyT, dataT>> A = B->right;
-    std::shared_ptr<Node<keyT, dataT>> AL = A->left;
-    std::shared_ptr<Node<keyT, dataT>> AR = A->right;
+    NodePtr B = std::move(root);
+    NodePtr A = std::move(B->right);
+
+    B->right = std::move(A->left);
+    UpdateNode(B);
+    A->left = std::move(B);
+    UpdateNode(A);
 
-    B->right = AL;
-    A->left = B;
-    
-    B->height = IntMax(GetHeight(B->left), GetHeight(B->right)) + 1;
-    A->height = IntMax(GetHeight(A->left), GetHeight(A->right)) + 1;
-    
     return A;
 }
 
 
-template <class keyT, class dataT>
-std::shared_ptr<Node<keyT, dataT>> BST<keyT, dataT>::InsertAux(std::shared_ptr<Node<keyT, dataT>> root, 
-                                                            std::shared_ptr<Node<keyT, dataT>> toInsert)
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+void BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Rebalance(NodePtr& root)
 {
-    if (root == nullptr) 
-        return toInsert;
-    
-    if (root->key < toInsert->key)
-        root->right = BST<keyT, dataT>::InsertAux(root->right, toInsert);
-    else
-        root->left = BST<keyT, dataT>::InsertAux(root->left, toInsert);
-    
-    root->height = IntMax(GetHeight(root->left), GetHeight(root->right)) + 1;
+    UpdateNode(root);
     int balanceFactor = GetBF(root);
 
     if (balanceFactor == 2) {
-        if (BST<keyT, dataT>::GetBF(root->left) >= 0)
-            return BST<keyT, dataT>::LLRotation(root);
-        else if (BST<keyT, dataT>::GetBF(root->left) == -1)
-            return BST<keyT, dataT>::LRRotation(root);
+        if (BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::GetBF(root->left) >= 0)
+            root = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::LLRotation(root);
+        else
+            root = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::LRRotation(root);
     }
     else if (balanceFactor == -2) {
-        if (BST<keyT, dataT>::GetBF(root->right) <= 0)
-            return BST<keyT, dataT>::RRRotation(root);
-        else if (BST<keyT, dataT>::GetBF(root->right) == 1)
-            return BST<keyT, dataT>::RLRotation(root);
-    }  
-    return root;
+        if (BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::GetBF(root->right) <= 0)
+            root = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::RRRotation(root);
+        else
+            root = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::RLRotation(root);
+    }
 }
 
-template <class keyT, class dataT>
-void BST<keyT, dataT>::Remove(const keyT& key)
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+void BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Remove(const keyT& key)
 {
-    if(!this->Find(key))
-        return;
-    
-    this->root = BST<keyT, dataT>::RemoveAux(this->root, key);
-    this->size--;
+    this->Extract(key);
 }
 
-template <class keyT, class dataT>
-std::shared_ptr<Node<keyT, dataT>> BST<keyT, dataT>::RemoveAux(std::shared_ptr<Node<keyT, dataT>>& root, const keyT& key)
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::TakenT BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Extract(const keyT& key)
 {
-    if (root == nullptr)
-        return nullptr;
-    
-    if (root->key < key)
-        root->right = BST<keyT, dataT>::RemoveAux(root->right, key);
-    else if (root->key > key)
-        root->left = BST<keyT, dataT>::RemoveAux(root->left, key);
-    
-    else {
-        if (!root->left && !root->right)
-            root = nullptr;
-        
-        else if (root->left && root->right) {
-            std::shared_ptr<Node<keyT, dataT>> leaf = BST<keyT, dataT>::FindNextInOrder(root);
-            root->key = leaf->key;
-            root->data = leaf->data;
-            root->right = BST<keyT, dataT>::RemoveAux(root->right, leaf->key);
+    NodePtr* path[MAX_DEPTH];
+    int depth;
+    NodePtr* link = this->Descend(key, path, &depth);
+    if (*link == nullptr)
+        return TakenT();
+
+    NodeT* target = Pool::Raw(*link);
+    TakenT removed = ValuePolicy::Take(target->data);
+
+    if (target->left && target->right) {
+        path[depth++] = link;
+        link = &target->right;
+        while ((*link)->left != nullptr) {
+            path[depth++] = link;
+            link = &(*link)->left;
         }
+        target->key = std::move((*link)->key);
+        target->data = std::move((*link)->data);
+    }
+
+    NodePtr child = (*link)->left ? std::move((*link)->left) : std::move((*link)->right);
+    pool.Release(*link);
+    *link = std::move(child);
+
+    BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::RebalancePath(path, depth);
+    this->size--;
+    return removed;
+}
 
-        else if (root->left)
-            root = root->left;
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+int BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::CountLess(const keyT& key, bool inclusive) const
+{
+    int rank = 0;
+    const NodeT* curr = Pool::Raw(this->root);
+    while (curr != nullptr) {
+        int order = Compare::Order(curr->key, key);
+        if (order < 0 || (inclusive && order == 0)) {
+            rank += GetCount(curr->left) + 1;
+            curr = Pool::Raw(curr->right);
+        }
         else
-            root = root->right;   
+            curr = Pool::Raw(curr->left);
     }
-    
-    if (root == nullptr)
-        return nullptr;
-    
-    root->height = IntMax(GetHeight(root->left), GetHeight(root->right)) + 1;
-    int balanceFactor = GetBF(root);
+    return rank;
+}
 
-    if (balanceFactor == 2) {
-        if (BST<keyT, dataT>::GetBF(root->left) >= 0)
-            return BST<keyT, dataT>::LLRotation(root);
-        else if (BST<keyT, dataT>::GetBF(root->left) == -1)
-            return BST<keyT, dataT>::LRRotation(root);
-    }
-    else if (balanceFactor == -2) {
-        if (BST<keyT, dataT>::GetBF(root->right) <= 0)
-            return BST<keyT, dataT>::RRRotation(root);
-        else if (BST<keyT, dataT>::GetBF(root->right) == 1)
-            return BST<keyT, dataT>::RLRotation(root);
-    }  
-    return root;
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+int BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Rank(const keyT& key) const
+{
+    return this->CountLess(key, false);
 }
 
-template <class keyT, class dataT>
-std::shared_ptr<Node<keyT, dataT>> BST<keyT, dataT>::FindNextInOrder(std::shared_ptr<Node<keyT, dataT>> root)
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+const keyT& BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Select(int i) const
 {
-    root = root->right;
-    while(root->left != nullptr)
-        root = root->left;
+    if (i < 0 || i >= this->size)
+        throw std::out_of_range("BST::Select");
+
+    const NodeT* curr = Pool::Raw(this->root);
+    while (true) {
+        int leftCount = GetCount(curr->left);
+        if (i == leftCount)
+            return curr->key;
+        if (i < leftCount)
+            curr = Pool::Raw(curr->left);
+        else {
+            i -= leftCount + 1;
+            curr = Pool::Raw(curr->right);
+        }
+    }
+}
 
-    return root;
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+int BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::CountRange(const keyT& lo, const keyT& hi) const
+{
+    if (Compare::Order(hi, lo) < 0)
+        return 0;
+    return this->CountLess(hi, true) - this->CountLess(lo, false);
 }
 
-template <class keyT, class dataT>
-void BST<keyT, dataT>::MergeArr(std::shared_ptr<keyT> *keyArr1, std::shared_ptr<keyT> *keyArr2, std::shared_ptr<dataT> *dataArr1,
-                                std::shared_ptr<dataT> *dataArr2, std::shared_ptr<keyT> *keyMergedArr, std::shared_ptr<dataT> *dataMergedArr,
-                                int size1, int size2)
+/*
+* Combines the values with keys in [lo, hi] in key order. Below the first node
+* inside the range, the walk down each boundary picks up whole subtrees from
+* their cached summaries, so only two root-to-leaf paths are visited.
+*/
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename Augment::type BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Aggregate(const keyT& lo, const keyT& hi) const
 {
-    while (size1 > 0 && size2 > 0) {
-        if (**keyArr1 < **keyArr2) {
-            *keyMergedArr = std::shared_ptr<keyT>(*keyArr1);
-            *dataMergedArr = std::shared_ptr<dataT>(*dataArr1);
-            keyArr1++;
-            dataArr1++;
-            size1--;
+    static_assert(Augmented::value, "Aggregate needs an augmentation policy");
+
+    if (Compare::Order(hi, lo) < 0)
+        return Augment::Identity();
+    const NodeT* split = Pool::Raw(this->root);
+    while (split != nullptr) {
+        if (Compare::Order(split->key, lo) < 0)
+            split = Pool::Raw(split->right);
+        else if (Compare::Order(split->key, hi) > 0)
+            split = Pool::Raw(split->left);
+        else
+            break;
+    }
+    if (split == nullptr)
+        return Augment::Identity();
+
+    typename Augment::type left = Augment::Identity();
+    for (const NodeT* curr = Pool::Raw(split->left); curr != nullptr; ) {
+        if (Compare::Order(curr->key, lo) < 0)
+            curr = Pool::Raw(curr->right);
+        else {
+            left = Augment::Combine(Augment::Combine(Lift(curr->data), GetSummary(curr->right)), left);
+            curr = Pool::Raw(curr->left);
         }
+    }
+
+    typename Augment::type right = Augment::Identity();
+    for (const NodeT* curr = Pool::Raw(split->right); curr != nullptr; ) {
+        if (Compare::Order(curr->key, hi) > 0)
+            curr = Pool::Raw(curr->left);
         else {
-            *keyMergedArr = std::shared_ptr<keyT>(*keyArr2);
-            *dataMergedArr = std::shared_ptr<dataT>(*dataArr2);
-            keyArr2++;
-            dataArr2++;
-            size2--;
+            right = Augment::Combine(right, Augment::Combine(GetSummary(curr->left), Lift(curr->data)));
+            curr = Pool::Raw(curr->right);
         }
-        keyMergedArr++;
-        dataMergedArr++;
     }
 
-    while (size1 > 0) {    
-        *keyMergedArr = std::shared_ptr<keyT>(*keyArr1);
-        *dataMergedArr = std::shared_ptr<dataT>(*dataArr1);
-        keyArr1++;
-        dataArr1++;
-        keyMergedArr++;
-        dataMergedArr++;
-        size1--;
+    return Augment::Combine(Augment::Combine(left, Lift(split->data)), right);
+}
+
+/*
+* const_iterator walks the tree in key order. It keeps the path from the root to
+* the current node, so moving in either direction needs no parent links, no
+* recursion and no allocation. Any insertion or removal invalidates it.
+*/
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+class BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::const_iterator {
+    private:
+        const NodeT* treeRoot;
+        const NodeT* path[MAX_DEPTH];
+        int depth;
+
+        explicit const_iterator(const NodeT* treeRoot) : treeRoot(treeRoot), depth(0) {}
+        void Push(const NodeT* node) { path[depth++] = node; }
+        void PushLeftSpine(const NodeT* node);
+        void PushRightSpine(const NodeT* node);
+
+        friend class BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>;
+
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef NodeT value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const NodeT* pointer;
+        typedef const NodeT& reference;
+
+        const NodeT& operator*() const { return *path[depth - 1]; }
+        const NodeT* operator->() const { return path[depth - 1]; }
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+        bool operator==(const const_iterator& iterator) const;
+        bool operator!=(const const_iterator& iterator) const { return !(*this == iterator); }
+};
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+void BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::const_iterator::PushLeftSpine(const NodeT* node)
+{
+    while (node != nullptr) {
+        Push(node);
+        node = Pool::Raw(node->left);
+    }
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+void BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::const_iterator::PushRightSpine(const NodeT* node)
+{
+    while (node != nullptr) {
+        Push(node);
+        node = Pool::Raw(node->right);
     }
-    
-    while (size2 > 0) {    
-        *keyMergedArr = std::shared_ptr<keyT>(*keyArr2);
-        *dataMergedArr = std::shared_ptr<dataT>(*dataArr2);
-        keyArr2++;
-        dataArr2++;
-        keyMergedArr++;
-        dataMergedArr++;
-        size2--;
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::const_iterator& BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::const_iterator::operator++()
+{
+    const NodeT* node = path[depth - 1];
+    if (node->right != nullptr) {
+        PushLeftSpine(Pool::Raw(node->right));
+        return *this;
     }
+
+    const NodeT* child;
+    do {
+        child = path[--depth];
+    } while (depth > 0 && Pool::Raw(path[depth - 1]->right) == child);
+    return *this;
 }
 
-template <class keyT, class dataT>
-void BST<keyT, dataT>::SaveInOrder(const std::shared_ptr<Node<keyT, dataT>> root,
-                                     std::shared_ptr<keyT> *keyArr, std::shared_ptr<dataT> *dataArr, int *i)
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::const_iterator BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::const_iterator::operator++(int)
 {
-    if(root == nullptr)
-        return;
-    BST<keyT, dataT>::SaveInOrder(root->left, keyArr, dataArr, i);
-    keyArr[*i] = std::make_shared<keyT>(keyT(root->key));
-    dataArr[*i] = std::shared_ptr<dataT>(root->data);
-    (*i)++;
-    BST<keyT, dataT>::SaveInOrder(root->right, keyArr, dataArr, i);
-}
-
-template <class keyT, class dataT>
-BST<keyT, dataT> BST<keyT, dataT>::Merge(const BST<keyT, dataT>& tree1, const BST<keyT, dataT>& tree2)
-{
-    Map* map = BST<keyT, dataT>::MergeToArr(tree1, tree2);
-    BST<keyT, dataT> mergedBST = BST<keyT, dataT>::BuildEmptyTree(tree1.size + tree2.size);
-    int i = 0;
-    BST<keyT, dataT>::InsertElements(mergedBST.root, (std::shared_ptr<keyT> *)(map->key), (std::shared_ptr<dataT> *)(map->data), tree1.size + tree2.size, &i);
-    delete[] (std::shared_ptr<keyT> *)(map->key);
-    delete[] (std::shared_ptr<dataT> *)(map->data);
-    MapDestroy(map);
-    return mergedBST;   
-}
-
-template <class keyT, class dataT>
-Map* BST<keyT, dataT>::MergeToArr(const BST<keyT, dataT>& tree1, const BST<keyT, dataT>& tree2)
-{
-    std::shared_ptr<dataT> *dataArr1 = new std::shared_ptr<dataT>[tree1.size];
-    std::shared_ptr<dataT> *dataArr2 = new std::shared_ptr<dataT>[tree2.size];
-    std::shared_ptr<dataT> *dataMergedArr = new std::shared_ptr<dataT>[tree1.size + tree2.size];
-    std::shared_ptr<keyT> *keyArr1 = new std::shared_ptr<keyT>[tree1.size];
-    std::shared_ptr<keyT> *keyArr2 = new std::shared_ptr<keyT>[tree2.size];
-    std::shared_ptr<keyT> *keyMergedArr = new std::shared_ptr<keyT>[tree1.size + tree2.size];
-    int i = 0;
-    SaveInOrder(tree1.root, keyArr1, dataArr1, &i);
-    i = 0;
-    SaveInOrder(tree2.root, keyArr2, dataArr2, &i);
-    MergeArr(keyArr1, keyArr2, dataArr1, dataArr2, keyMergedArr, dataMergedArr, tree1.size, tree2.size);
-    delete[] dataArr1;
-    delete[] dataArr2;
-    delete[] keyArr1;
-    delete[] keyArr2;
-    Map* map = MapCreate((void*)keyMergedArr, (void*)dataMergedArr);
-    return map;  
-}
-
-template <class keyT, class dataT>
-BST<keyT, dataT> BST<keyT, dataT>::ArrToBST(Map* map, int size, int oldSize)
-{
-    BST<keyT, dataT> mergedBST = BST<keyT, dataT>::BuildEmptyTree(size);
-    int i = 0;
-    BST<keyT, dataT>::InsertElements(mergedBST.root, (std::shared_ptr<keyT> *)(map->key), (std::shared_ptr<dataT> *)(map->data), oldSize, &i);
-    delete[] (std::shared_ptr<keyT> *)(map->key);
-    delete[] (std::shared_ptr<dataT> *)(map->data);
-
-    return mergedBST;   
-}
-
-
-template <class keyT, class dataT>
-void BST<keyT, dataT>::InsertElements(std::shared_ptr<Node<keyT, dataT>> root, std::shared_ptr<keyT> *keyArr,
-                                      std::shared_ptr<dataT> *dataArr, int size, int *i)
-{
-    if(root == nullptr)
-        return;
+    const_iterator result = *this;
+    ++*this;
+    return result;
+}
 
-    BST<keyT, dataT>::InsertElements(root->left, keyArr, dataArr, size, i);
-    
-    while (*i < size && dataArr[*i] == nullptr) {
-        (*i)++;
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::const_iterator& BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::const_iterator::operator--()
+{
+    if (depth == 0) {
+        PushRightSpine(treeRoot);
+        return *this;
     }
-    root->data = dataArr[*i];
-    root->key = *(keyArr[*i]);
-    (*i)++;
-    BST<keyT, dataT>::InsertElements(root->right, keyArr, dataArr, size, i);
 
-    return;
+    const NodeT* node = path[depth - 1];
+    if (node->left != nullptr) {
+        PushRightSpine(Pool::Raw(node->left));
+        return *this;
+    }
+
+    const NodeT* child;
+    do {
+        child = path[--depth];
+    } while (depth > 0 && Pool::Raw(path[depth - 1]->left) == child);
+    return *this;
 }
 
-template <class keyT, class dataT>
-BST<keyT, dataT> BST<keyT, dataT>::BuildEmptyTree(int n)
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::const_iterator BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::const_iterator::operator--(int)
 {
-    int completeHeight = BST<keyT, dataT>::FindHeightOfComplete(n + 1);
-    int completeSize = BST<keyT, dataT>::ComputeSizeOfComplete(completeHeight);
-    BST<keyT, dataT> res = BST<keyT, dataT>(BST<keyT, dataT>::BuildCompleteTree(completeHeight), completeSize);
-    int removeCount = completeSize - n;
-    removeRightLeafs(res.root, &removeCount, completeHeight, 0);
+    const_iterator result = *this;
+    --*this;
+    return result;
+}
 
-    res.size = n;
-    return res;
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+bool BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::const_iterator::operator==(const const_iterator& iterator) const
+{
+    if (depth == 0 || iterator.depth == 0)
+        return depth == iterator.depth;
+    return path[depth - 1] == iterator.path[iterator.depth - 1];
 }
 
-template <class keyT, class dataT>
-void BST<keyT, dataT>::removeRightLeafs(std::shared_ptr<Node<keyT, dataT>> root, int* removecount, int leafPathLen, int currPathLen)
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::const_iterator BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::begin() const
 {
-    if(root == nullptr || *removecount == 0)
-        return;
+    const_iterator result(Pool::Raw(this->root));
+    result.PushLeftSpine(Pool::Raw(this->root));
+    return result;
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::const_iterator BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::end() const
+{
+    return const_iterator(Pool::Raw(this->root));
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+template <class K>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::const_iterator BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::LowerBound(const K& key) const
+{
+    const_iterator result(Pool::Raw(this->root));
+    int found = 0;
+    const NodeT* curr = Pool::Raw(this->root);
+    while (curr != nullptr) {
+        result.Push(curr);
+        if (Compare::Order(curr->key, key) < 0)
+            curr = Pool::Raw(curr->right);
+        else {
+            found = result.depth;
+            curr = Pool::Raw(curr->left);
+        }
+    }
+    result.depth = found;
+    return result;
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+template <class K>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::const_iterator BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::UpperBound(const K& key) const
+{
+    const_iterator result(Pool::Raw(this->root));
+    int found = 0;
+    const NodeT* curr = Pool::Raw(this->root);
+    while (curr != nullptr) {
+        result.Push(curr);
+        if (Compare::Order(curr->key, key) > 0) {
+            found = result.depth;
+            curr = Pool::Raw(curr->left);
+        }
+        else
+            curr = Pool::Raw(curr->right);
+    }
+    result.depth = found;
+    return result;
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::const_iterator BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::lower_bound(const keyT& key) const
+{
+    return this->LowerBound(key);
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::const_iterator BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::upper_bound(const keyT& key) const
+{
+    return this->UpperBound(key);
+}
 
-    BST<keyT, dataT>::removeRightLeafs(root->right, removecount, leafPathLen, currPathLen + 1);
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+std::pair<typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::const_iterator, typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::const_iterator>
+BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::equal_range(const keyT& key) const
+{
+    const_iterator first = this->LowerBound(key);
+    const_iterator last = first;
+    if (last != this->end() && Compare::Order(last->key, key) == 0)
+        ++last;
+    return std::make_pair(first, last);
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+template <class K, class C, class>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::const_iterator BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::lower_bound(const K& key) const
+{
+    return this->LowerBound(key);
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+template <class K, class C, class>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::const_iterator BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::upper_bound(const K& key) const
+{
+    return this->UpperBound(key);
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+template <class K, class C, class>
+std::pair<typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::const_iterator, typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::const_iterator>
+BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::equal_range(const K& key) const
+{
+    const_iterator first = this->LowerBound(key);
+    const_iterator last = first;
+    if (last != this->end() && Compare::Order(last->key, key) == 0)
+        ++last;
+    return std::make_pair(first, last);
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+template <class Function>
+void BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::ForEachInRange(const keyT& lo, const keyT& hi, Function fn) const
+{
+    const_iterator end = this->end();
+    for (const_iterator it = this->LowerBound(lo); it != end && Compare::Order(it->key, hi) <= 0; ++it)
+        fn(it->key, it->data);
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::NodePtr BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::JoinAux(NodePtr left, NodePtr pivot, NodePtr right)
+{
+    int leftHeight = GetHeight(left);
+    int rightHeight = GetHeight(right);
+
+    if (leftHeight > rightHeight + 1) {
+        left->right = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::JoinAux(std::move(left->right), std::move(pivot), std::move(right));
+        BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Rebalance(left);
+        return left;
+    }
+    if (rightHeight > leftHeight + 1) {
+        right->left = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::JoinAux(std::move(left), std::move(pivot), std::move(right->left));
+        BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Rebalance(right);
+        return right;
+    }
+
+    pivot->left = std::move(left);
+    pivot->right = std::move(right);
+    UpdateNode(pivot);
+    return pivot;
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+void BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::SplitAux(NodePtr root, const keyT& key, NodePtr& left, NodePtr& found, NodePtr& right)
+{
+    if (root == nullptr) {
+        left = nullptr;
+        right = nullptr;
+        return;
+    }
 
-    if (currPathLen + 1 == leafPathLen) {
+    int order = Compare::Order(root->key, key);
+    if (order == 0) {
+        left = std::move(root->left);
+        right = std::move(root->right);
+        root->left = nullptr;
         root->right = nullptr;
-        (*removecount)--;
+        UpdateNode(root);
+        found = std::move(root);
+    }
+    else if (order > 0) {
+        NodePtr rightPart;
+        BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::SplitAux(std::move(root->left), key, left, found, rightPart);
+        NodePtr rootRight = std::move(root->right);
+        right = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::JoinAux(std::move(rightPart), std::move(root), std::move(rootRight));
     }
-    if (currPathLen + 1 == leafPathLen && *removecount > 0) {
+    else {
+        NodePtr leftPart;
+        BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::SplitAux(std::move(root->right), key, leftPart, found, right);
+        NodePtr rootLeft = std::move(root->left);
+        left = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::JoinAux(std::move(rootLeft), std::move(root), std::move(leftPart));
+    }
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::NodePtr BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::SplitLast(NodePtr root, NodePtr& last)
+{
+    if (root->right == nullptr) {
+        NodePtr left = std::move(root->left);
         root->left = nullptr;
-        (*removecount)--;
-        root->height--;
+        UpdateNode(root);
+        last = std::move(root);
+        return left;
+    }
+
+    NodePtr right = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::SplitLast(std::move(root->right), last);
+    NodePtr left = std::move(root->left);
+    return BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::JoinAux(std::move(left), std::move(root), std::move(right));
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::NodePtr BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::SplitFirst(NodePtr root, NodePtr& first)
+{
+    if (root->left == nullptr) {
+        NodePtr right = std::move(root->right);
+        root->right = nullptr;
+        UpdateNode(root);
+        first = std::move(root);
+        return right;
     }
 
-    BST<keyT, dataT>::removeRightLeafs(root->left, removecount, leafPathLen, currPathLen + 1);
-    return;
+    NodePtr left = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::SplitFirst(std::move(root->left), first);
+    NodePtr right = std::move(root->right);
+    return BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::JoinAux(std::move(left), std::move(root), std::move(right));
 }
 
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::NodePtr BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Join2(NodePtr left, NodePtr right)
+{
+    if (left == nullptr)
+        return right;
+    NodePtr last = nullptr;
+    NodePtr rest = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::SplitLast(std::move(left), last);
+    return BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::JoinAux(std::move(rest), std::move(last), std::move(right));
+}
 
-template <class keyT, class dataT>
-std::shared_ptr<Node<keyT, dataT>> BST<keyT, dataT>::BuildCompleteTree(int h)
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+bool BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Fork(TaskPool* tasks, const NodePtr& tree1, const NodePtr& tree2)
 {
-    if (h == -1)
+    return tasks != nullptr && GetCount(tree1) + GetCount(tree2) > PARALLEL_GRAIN;
+}
+
+/*
+* Hands a node the set operations no longer need back to nodes. A free list is
+* not shared between threads, so every forked task gets a pool of its own that
+* its parent absorbs after the join, and each node ends up on the result's
+* free list either way.
+*/
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+void BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::DropNode(NodePtr& node, Pool& nodes)
+{
+    if (node == nullptr)
+        return;
+    node->left = nullptr;
+    node->right = nullptr;
+    nodes.Release(node);
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::NodePtr BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::UnionAux(NodePtr tree1, NodePtr tree2, Pool& nodes, TaskPool* tasks)
+{
+    if (tree1 == nullptr)
+        return tree2;
+    if (tree2 == nullptr)
+        return tree1;
+
+    NodePtr left2 = nullptr;
+    NodePtr duplicate = nullptr;
+    NodePtr right2 = nullptr;
+    BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::SplitAux(std::move(tree2), tree1->key, left2, duplicate, right2);
+
+    NodePtr left1 = std::move(tree1->left);
+    NodePtr right1 = std::move(tree1->right);
+    NodePtr left = nullptr;
+    NodePtr right = nullptr;
+    if (Fork(tasks, tree1, right2)) {
+        Pool spare;
+        tasks->Invoke([&] { left = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::UnionAux(std::move(left1), std::move(left2), nodes, tasks); },
+                      [&] { right = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::UnionAux(std::move(right1), std::move(right2), spare, tasks); });
+        nodes.Absorb(spare);
+    }
+    else {
+        left = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::UnionAux(std::move(left1), std::move(left2), nodes, tasks);
+        right = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::UnionAux(std::move(right1), std::move(right2), nodes, tasks);
+    }
+    DropNode(duplicate, nodes);
+    return BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::JoinAux(std::move(left), std::move(tree1), std::move(right));
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::NodePtr BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::IntersectionAux(NodePtr tree1, NodePtr tree2, Pool& nodes, TaskPool* tasks)
+{
+    if (tree1 == nullptr || tree2 == nullptr) {
+        nodes.ReleaseTree(tree1);
+        nodes.ReleaseTree(tree2);
         return nullptr;
-    std::shared_ptr<Node<keyT, dataT>> root = std::shared_ptr<Node<keyT, dataT>>(new Node<keyT, dataT>(h));
-    root->right = BST<keyT, dataT>::BuildCompleteTree(h - 1);
-    root->left = BST<keyT, dataT>::BuildCompleteTree(h - 1);
-    return root;
+    }
+
+    NodePtr left2 = nullptr;
+    NodePtr duplicate = nullptr;
+    NodePtr right2 = nullptr;
+    BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::SplitAux(std::move(tree2), tree1->key, left2, duplicate, right2);
+
+    NodePtr left1 = std::move(tree1->left);
+    NodePtr right1 = std::move(tree1->right);
+    NodePtr left = nullptr;
+    NodePtr right = nullptr;
+    if (Fork(tasks, tree1, right2)) {
+        Pool spare;
+        tasks->Invoke([&] { left = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::IntersectionAux(std::move(left1), std::move(left2), nodes, tasks); },
+                      [&] { right = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::IntersectionAux(std::move(right1), std::move(right2), spare, tasks); });
+        nodes.Absorb(spare);
+    }
+    else {
+        left = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::IntersectionAux(std::move(left1), std::move(left2), nodes, tasks);
+        right = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::IntersectionAux(std::move(right1), std::move(right2), nodes, tasks);
+    }
+
+    if (duplicate == nullptr) {
+        DropNode(tree1, nodes);
+        return BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Join2(std::move(left), std::move(right));
+    }
+    DropNode(duplicate, nodes);
+    return BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::JoinAux(std::move(left), std::move(tree1), std::move(right));
 }
 
-template <class keyT, class dataT>
-int BST<keyT, dataT>::FindHeightOfComplete(int num)
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::NodePtr BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::DifferenceAux(NodePtr tree1, NodePtr tree2, Pool& nodes, TaskPool* tasks)
 {
-    int twoPow = 1;
-    int height = -1;
-    while(twoPow < num)
-    {
-        twoPow *= 2;
-        height++;
+    if (tree1 == nullptr) {
+        nodes.ReleaseTree(tree2);
+        return nullptr;
+    }
+    if (tree2 == nullptr)
+        return tree1;
+
+    NodePtr left1 = nullptr;
+    NodePtr duplicate = nullptr;
+    NodePtr right1 = nullptr;
+    BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::SplitAux(std::move(tree1), tree2->key, left1, duplicate, right1);
+
+    NodePtr left2 = std::move(tree2->left);
+    NodePtr right2 = std::move(tree2->right);
+    NodePtr left = nullptr;
+    NodePtr right = nullptr;
+    if (Fork(tasks, tree2, right1)) {
+        Pool spare;
+        tasks->Invoke([&] { left = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::DifferenceAux(std::move(left1), std::move(left2), nodes, tasks); },
+                      [&] { right = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::DifferenceAux(std::move(right1), std::move(right2), spare, tasks); });
+        nodes.Absorb(spare);
+    }
+    else {
+        left = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::DifferenceAux(std::move(left1), std::move(left2), nodes, tasks);
+        right = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::DifferenceAux(std::move(right1), std::move(right2), nodes, tasks);
     }
-    return height;
+    DropNode(duplicate, nodes);
+    DropNode(tree2, nodes);
+    return BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Join2(std::move(left), std::move(right));
 }
 
-template <class keyT, class dataT>
-int BST<keyT, dataT>::ComputeSizeOfComplete(int height)
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare> BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::TakeBoth(BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>& tree1, BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>& tree2)
 {
-    int n = 1;
-    int count = 1;
+    BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare> result;
+    result.pool.Absorb(tree1.pool);
+    result.pool.Absorb(tree2.pool);
+    return result;
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare> BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Union(BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& tree1, BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& tree2,
+                                                                 TaskPool* tasks)
+{
+    BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare> result = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::TakeBoth(tree1, tree2);
+    result.root = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::UnionAux(std::move(tree1.root), std::move(tree2.root), result.pool, tasks);
+    result.size = GetCount(result.root);
+
+    tree1.root = nullptr;
+    tree1.size = 0;
+    tree2.root = nullptr;
+    tree2.size = 0;
+    return result;
+}
 
-    while(count <= height + 1) {
-        n *= 2;
-        count++;
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare> BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Intersection(BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& tree1, BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& tree2,
+                                                                        TaskPool* tasks)
+{
+    BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare> result = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::TakeBoth(tree1, tree2);
+    result.root = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::IntersectionAux(std::move(tree1.root), std::move(tree2.root), result.pool, tasks);
+    result.size = GetCount(result.root);
+
+    tree1.root = nullptr;
+    tree1.size = 0;
+    tree2.root = nullptr;
+    tree2.size = 0;
+    return result;
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare> BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Difference(BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& tree1, BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& tree2,
+                                                                      TaskPool* tasks)
+{
+    BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare> result = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::TakeBoth(tree1, tree2);
+    result.root = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::DifferenceAux(std::move(tree1.root), std::move(tree2.root), result.pool, tasks);
+    result.size = GetCount(result.root);
+
+    tree1.root = nullptr;
+    tree1.size = 0;
+    tree2.root = nullptr;
+    tree2.size = 0;
+    return result;
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare> BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Join(BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& left, const keyT& key,
+                                                                StoredT data, BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& right)
+{
+    BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare> joined;
+    joined.pool.Absorb(left.pool);
+    joined.pool.Absorb(right.pool);
+    NodePtr pivot = joined.pool.Create(key, std::move(data));
+    joined.root = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::JoinAux(std::move(left.root), std::move(pivot), std::move(right.root));
+    joined.size = left.size + right.size + 1;
+
+    left.root = nullptr;
+    left.size = 0;
+    right.root = nullptr;
+    right.size = 0;
+    return joined;
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::TakenT BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Split(BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& tree, const keyT& key,
+                                                           BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>& left, BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>& right)
+{
+    if (&left == &right)
+        throw std::invalid_argument("BST::Split: left and right must be different trees");
+
+    NodePtr leftRoot = nullptr;
+    NodePtr found = nullptr;
+    NodePtr rightRoot = nullptr;
+    BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::SplitAux(std::move(tree.root), key, leftRoot, found, rightRoot);
+    tree.root = nullptr;
+    tree.size = 0;
+
+    //The halves are built aside, since tree may be left or right and its pool must outlive the nodes it still links.
+    BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare> leftPart;
+    BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare> rightPart;
+    leftPart.pool.Absorb(tree.pool);
+    rightPart.pool.Share(leftPart.pool);
+    leftPart.root = std::move(leftRoot);
+    leftPart.size = GetCount(leftPart.root);
+    rightPart.root = std::move(rightRoot);
+    rightPart.size = GetCount(rightPart.root);
+
+    TakenT data = found != nullptr ? ValuePolicy::Take(found->data) : TakenT();
+    leftPart.pool.Release(found);
+    left = std::move(leftPart);
+    right = std::move(rightPart);
+    return data;
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare> BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Merge(BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& tree1, BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>&& tree2)
+{
+    return BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Union(std::move(tree1), std::move(tree2));
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare> BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Merge(const BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>& tree1, const BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>& tree2)
+{
+    BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare> merged;
+    merged.pool.Reserve(tree1.size + tree2.size);
+    NodePtr vine = nullptr;
+    NodePtr* tail = &vine;
+    int n = 0;
+
+    const_iterator it1 = tree1.begin();
+    const_iterator it2 = tree2.begin();
+    const_iterator end1 = tree1.end();
+    const_iterator end2 = tree2.end();
+    while (it1 != end1 || it2 != end2) {
+        const NodeT* next;
+        int order = it1 == end1 ? 1 : it2 == end2 ? -1 : Compare::Order(it1->key, it2->key);
+        if (order <= 0) {
+            if (order == 0)
+                ++it2;
+            next = &*it1;
+            ++it1;
+        }
+        else {
+            next = &*it2;
+            ++it2;
+        }
+        *tail = merged.pool.Create(next->key, next->data);
+        tail = &(*tail)->right;
+        n++;
     }
 
-    return n - 1;
+    merged.root = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::BuildFromVine(vine, n);
+    merged.size = n;
+    return merged;
+}
+
+//Turns n nodes chained through their right links into a height balanced tree.
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::NodePtr BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::BuildFromVine(NodePtr& head, int n)
+{
+    if (n == 0)
+        return nullptr;
+
+    NodePtr left = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::BuildFromVine(head, n / 2);
+    NodePtr node = std::move(head);
+    head = std::move(node->right);
+    node->left = std::move(left);
+    node->right = BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::BuildFromVine(head, n - n / 2 - 1);
+    UpdateNode(node);
+    return node;
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+template <class Iterator>
+void BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::ReserveFor(Iterator begin, Iterator end, std::forward_iterator_tag)
+{
+    pool.Reserve((int)std::distance(begin, end));
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+template <class Iterator>
+BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare> BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::FromSorted(Iterator begin, Iterator end)
+{
+    BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare> result;
+    result.root = result.BuildSorted(begin, end, &result.size);
+    return result;
+}
+
+//Builds a balanced tree out of this tree's pool; the nodes are not linked into the tree.
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+template <class Iterator>
+typename BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::NodePtr BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::BuildSorted(Iterator begin, Iterator end, int* n)
+{
+    this->ReserveFor(begin, end, typename std::iterator_traits<Iterator>::iterator_category());
+    NodePtr vine = nullptr;
+    NodePtr* tail = &vine;
+    *n = 0;
+    for (; begin != end; ++begin) {
+        *tail = pool.Create((*begin).first, (*begin).second);
+        tail = &(*tail)->right;
+        (*n)++;
+    }
+    return BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::BuildFromVine(vine, *n);
+}
+
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+FrozenBST<keyT, dataT, ValuePolicy, Compare> BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::Freeze() const
+{
+    return FrozenBST<keyT, dataT, ValuePolicy, Compare>(this->begin(), this->size);
 }
 
-template <class keyT, class dataT>
-dataT& BST<keyT, dataT>::GetMax()
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+dataT& BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::GetMax()
 {
-    std::shared_ptr<Node<keyT, dataT>> curr = this->root;
+    NodeT* curr = Pool::Raw(this->root);
     while(curr->right != nullptr)
-        curr = curr->right;
+        curr = Pool::Raw(curr->right);
 
-    return *(curr->data);
+    return ValuePolicy::Deref(curr->data);
 }
 
-template <class keyT, class dataT>
-dataT& BST<keyT, dataT>::GetMin()
+template <class keyT, class dataT, class NodePolicy, class Augment, class ValuePolicy, class Compare>
+dataT& BST<keyT, dataT, NodePolicy, Augment, ValuePolicy, Compare>::GetMin()
 {
-    std::shared_ptr<Node<keyT, dataT>> curr = this->root;
+    NodeT* curr = Pool::Raw(this->root);
     while(curr->left != nullptr)
-        curr = curr->left;
+        curr = Pool::Raw(curr->left);
 
-    return *(curr->data);
+    return ValuePolicy::Deref(curr->data);
 }
 
 #endif /* BST_H */
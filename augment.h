@@ -0,0 +1,65 @@
+#ifndef AUGMENT_H_
+#define AUGMENT_H_
+
+#include <limits>
+
+/*
+* Augmentation policies for BST. A policy caches a summary of every subtree in
+* its root, so range aggregates take O(log n). It provides
+*     typedef ... type;
+*     static type Identity();
+*     static type Lift(const dataT& data);
+*     static type Combine(const type& left, const type& right);
+* where Combine is associative and Identity is its neutral element. Combine
+* is always applied in key order, so it does not have to be commutative.
+* Summaries are refreshed when the tree inserts or assigns a value; changing a
+* value in place through the handle returned by Get leaves them stale.
+*
+* NoAugment (the default) stores nothing and costs nothing.
+*/
+struct NoAugment {
+    struct type {};
+};
+
+template <class T>
+struct SumAugment {
+    typedef T type;
+
+    static T Identity() { return T(); }
+    static T Lift(const T& data) { return data; }
+    static T Combine(const T& left, const T& right) { return left + right; }
+};
+
+template <class T>
+struct MinAugment {
+    typedef T type;
+
+    static T Identity() { return std::numeric_limits<T>::max(); }
+    static T Lift(const T& data) { return data; }
+    static T Combine(const T& left, const T& right) { return right < left ? right : left; }
+};
+
+template <class T>
+struct MaxAugment {
+    typedef T type;
+
+    static T Identity() { return std::numeric_limits<T>::lowest(); }
+    static T Lift(const T& data) { return data; }
+    static T Combine(const T& left, const T& right) { return left < right ? right : left; }
+};
+
+//Tree nodes derive from this; the NoAugment specialization is empty and takes no space.
+template <class Augment, class dataT>
+struct AugmentSlot {
+    typename Augment::type summary;
+
+    explicit AugmentSlot(const dataT* data) :
+        summary(data == nullptr ? Augment::Identity() : Augment::Lift(*data)) {}
+};
+
+template <class dataT>
+struct AugmentSlot<NoAugment, dataT> {
+    explicit AugmentSlot(const dataT*) {}
+};
+
+#endif /* AUGMENT_H_ */
@@ -0,0 +1,46 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+/*
+* Shared helpers for the benchmarks in this directory: a wall clock, the
+* problem size from the command line and a fixed-seed key generator, so two
+* runs of the same binary do the same work.
+*/
+inline double Seconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline int ArgOr(int argc, char** argv, int index, int fallback) {
+    return argc > index ? std::atoi(argv[index]) : fallback;
+}
+
+//xorshift64*, so the keys do not depend on the standard library in use.
+inline uint64_t NextRandom(uint64_t& state) {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545f4914f6cdd1dULL;
+}
+
+inline std::vector<int> RandomKeys(int n, uint64_t seed = 88172645463325252ULL) {
+    std::vector<int> keys(n);
+    for (int i = 0; i < n; i++)
+        keys[i] = (int)(NextRandom(seed) >> 33);
+    return keys;
+}
+
+//Keeps the optimizer from dropping a result.
+template <class T>
+inline void Consume(const T& value) {
+    static volatile T sink;
+    sink = value;
+    (void)sink;
+}
+
+#endif /* BENCH_H_ */
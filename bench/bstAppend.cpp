@@ -0,0 +1,59 @@
+#include <memory>
+#include "../BST.h"
+#include "../augment.h"
+#include "bench.h"
+
+/*
+* Appending n increasing keys to an augmented BST: one Insert per key, Insert
+* with the end() hint, and InsertSorted in batches of several sizes. The last
+* run gives every batch a few keys that fall inside the tree, so part of it
+* goes through the union.
+*
+*     bstAppend [n = 1000000]
+*/
+typedef BST<int, int, SlabNodePolicy, SumAugment<long>> Tree;
+
+template <class Fill>
+static void Time(const char* name, int n, Fill fill) {
+    Tree tree;
+    double start = Seconds();
+    fill(tree);
+    double elapsed = Seconds() - start;
+    Consume(tree.Aggregate(0, n));
+    std::printf("  %-28s %7.1fns/key  size %d\n", name, elapsed * 1e9 / n, tree.size);
+}
+
+static void Batches(Tree& tree, int n, int batch, int overlap) {
+    std::shared_ptr<int> data = std::make_shared<int>(1);
+    std::vector<std::pair<int, std::shared_ptr<int>>> keys;
+    for (int first = 0; first < n; first += batch) {
+        keys.clear();
+        int from = first >= overlap ? first - overlap : 0;
+        for (int key = from; key < first + batch && key < n; key++)
+            keys.emplace_back(key, data);
+        tree.InsertSorted(keys.begin(), keys.end());
+    }
+}
+
+int main(int argc, char** argv) {
+    int n = ArgOr(argc, argv, 1, 1000000);
+    std::printf("bstAppend: %d increasing keys\n", n);
+    Time("Insert(key)", n, [&](Tree& tree) {
+        std::shared_ptr<int> data = std::make_shared<int>(1);
+        for (int key = 0; key < n; key++)
+            tree.Insert(key, data);
+    });
+    Time("Insert(end(), key)", n, [&](Tree& tree) {
+        std::shared_ptr<int> data = std::make_shared<int>(1);
+        for (int key = 0; key < n; key++)
+            tree.Insert(tree.end(), key, data);
+    });
+    int batches[] = { 1, 16, 256, 4096 };
+    for (int batch : batches) {
+        char name[64];
+        std::snprintf(name, sizeof(name), "InsertSorted, batch %d", batch);
+        Time(name, n, [&](Tree& tree) { Batches(tree, n, batch, 0); });
+    }
+    Time("InsertSorted, 256 + 16 overlap", n, [&](Tree& tree) { Batches(tree, n, 256, 16); });
+    return 0;
+}
@@ -0,0 +1,39 @@
+#include <memory>
+#include "../BST.h"
+#include "bench.h"
+
+/*
+* Random inserts, lookups and destruction of a BST, with shared_ptr nodes and
+* with slab nodes.
+*
+*     bstInsert [n = 1000000]
+*/
+template <class NodePolicy>
+static void Run(const char* name, const std::vector<int>& keys) {
+    double start = Seconds();
+    double inserted;
+    long found = 0;
+    double looked;
+    {
+        BST<int, int, NodePolicy> tree;
+        for (int key : keys)
+            tree.Insert(key, std::make_shared<int>(key));
+        inserted = Seconds();
+        for (int key : keys)
+            found += tree.Find(key ^ 1);
+        looked = Seconds();
+    }
+    double destroyed = Seconds();
+    Consume(found);
+    std::printf("%-8s insert %.3fs  find %.3fs  destroy %.3fs  total %.3fs\n", name,
+                inserted - start, looked - inserted, destroyed - looked, destroyed - start);
+}
+
+int main(int argc, char** argv) {
+    int n = ArgOr(argc, argv, 1, 1000000);
+    std::vector<int> keys = RandomKeys(n);
+    std::printf("bstInsert: %d random keys\n", n);
+    Run<SharedNodePolicy>("shared", keys);
+    Run<SlabNodePolicy>("slab", keys);
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <memory>
+#include <thread>
+#include "../BST.h"
+#include "bench.h"
+
+/*
+* Merging a small delta into a large tree: the copying Merge against the
+* consuming Union, sequentially and on a TaskPool, plus Intersection and
+* Difference of two trees of the same size.
+*
+*     bstSetOps [base = 1000000] [threads = hardware]
+*/
+typedef BST<int, int, SlabNodePolicy> Tree;
+
+static Tree Build(const std::vector<int>& keys, int from, int to) {
+    Tree tree;
+    for (int i = from; i < to; i++)
+        tree.Insert(keys[i], std::make_shared<int>(keys[i]));
+    return tree;
+}
+
+template <class Operation>
+static void Time(const char* name, const std::vector<int>& keys, int base, int delta, Operation operation) {
+    Tree tree1 = Build(keys, 0, base);
+    Tree tree2 = Build(keys, base, base + delta);
+    double start = Seconds();
+    Tree result = operation(tree1, tree2);
+    double elapsed = Seconds() - start;
+    std::printf("  %-24s %9.2fms  size %d\n", name, elapsed * 1000, result.size);
+}
+
+int main(int argc, char** argv) {
+    int base = ArgOr(argc, argv, 1, 1000000);
+    int threads = ArgOr(argc, argv, 2, (int)std::thread::hardware_concurrency());
+    TaskPool tasks(threads);
+    std::vector<int> keys = RandomKeys(2 * base);
+    std::printf("bstSetOps: base %d keys, %d threads\n", base, tasks.Threads());
+
+    int deltas[] = { base / 1000, base / 10, base };
+    for (int delta : deltas) {
+        std::printf(" delta %d\n", delta);
+        Time("Merge (copying)", keys, base, delta, [](Tree& tree1, Tree& tree2) {
+            return Tree::Merge(static_cast<const Tree&>(tree1), static_cast<const Tree&>(tree2));
+        });
+        Time("Union", keys, base, delta, [](Tree& tree1, Tree& tree2) {
+            return Tree::Union(std::move(tree1), std::move(tree2));
+        });
+        Time("Union, TaskPool", keys, base, delta, [&](Tree& tree1, Tree& tree2) {
+            return Tree::Union(std::move(tree1), std::move(tree2), &tasks);
+        });
+    }
+
+    std::printf(" equal sizes, half the keys shared\n");
+    std::vector<int> shared(keys.begin(), keys.begin() + base);
+    shared.insert(shared.end(), keys.begin() + base / 2, keys.begin() + base / 2 + base);
+    Time("Intersection", shared, base, base, [](Tree& tree1, Tree& tree2) {
+        return Tree::Intersection(std::move(tree1), std::move(tree2));
+    });
+    Time("Intersection, TaskPool", shared, base, base, [&](Tree& tree1, Tree& tree2) {
+        return Tree::Intersection(std::move(tree1), std::move(tree2), &tasks);
+    });
+    Time("Difference", shared, base, base, [](Tree& tree1, Tree& tree2) {
+        return Tree::Difference(std::move(tree1), std::move(tree2));
+    });
+    Time("Difference, TaskPool", shared, base, base, [&](Tree& tree1, Tree& tree2) {
+        return Tree::Difference(std::move(tree1), std::move(tree2), &tasks);
+    });
+    return 0;
+}
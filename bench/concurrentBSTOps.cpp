@@ -0,0 +1,88 @@
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "../BST.h"
+#include "../concurrentBST.h"
+#include "bench.h"
+
+/*
+* Throughput of ConcurrentBST against a BST behind one mutex, from one thread
+* up to maxThreads, on 80% lookups, 10% inserts and 10% removes over a key
+* range that starts half full. The growth of the resident set during each run
+* (Linux only) stays small as long as retired nodes are reclaimed.
+*
+*     concurrentBSTOps [keys = 100000] [operations = 2000000] [maxThreads = 64]
+*/
+static double ResidentMB() {
+    long pages = 0, resident = 0;
+    FILE* statm = std::fopen("/proc/self/statm", "r");
+    if (statm == nullptr)
+        return 0;
+    if (std::fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+        resident = 0;
+    std::fclose(statm);
+    return resident * 4096.0 / (1 << 20);
+}
+
+template <class Tree, class Operation>
+static double Run(Tree& tree, int keys, int operations, int threads, Operation operation) {
+    std::vector<std::thread> workers;
+    double start = Seconds();
+    for (int w = 0; w < threads; w++) {
+        workers.emplace_back([&, w] {
+            uint64_t state = 0x9e3779b97f4a7c15ULL * (w + 1);
+            int found = 0;
+            for (int i = w; i < operations; i += threads) {
+                uint64_t random = NextRandom(state);
+                found += operation(tree, (int)((random >> 32) % keys), (int)(random % 10));
+            }
+            Consume(found);
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+    return operations / (Seconds() - start) / 1e6;
+}
+
+int main(int argc, char** argv) {
+    int keys = ArgOr(argc, argv, 1, 100000);
+    int operations = ArgOr(argc, argv, 2, 2000000);
+    int maxThreads = ArgOr(argc, argv, 3, 64);
+    std::printf("concurrentBSTOps: %d keys, %d operations, %u hardware threads\n",
+                keys, operations, std::thread::hardware_concurrency());
+    std::printf("  %7s %16s %12s %16s\n", "threads", "ConcurrentBST", "RSS growth", "BST + mutex");
+
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        double concurrent, grown, locked;
+        {
+            ConcurrentBST<int, int> tree;
+            for (int key = 0; key < keys; key += 2)
+                tree.Insert(key, std::make_shared<int>(key));
+            double before = ResidentMB();
+            concurrent = Run(tree, keys, operations, threads, [](ConcurrentBST<int, int>& tree, int key, int operation) {
+                if (operation == 0)
+                    return (int)tree.Insert(key, std::make_shared<int>(key));
+                if (operation == 1)
+                    return (int)(tree.Extract(key) != nullptr);
+                return (int)tree.Find(key);
+            });
+            grown = ResidentMB() - before;
+        }
+        {
+            BST<int, int> tree;
+            std::mutex lock;
+            for (int key = 0; key < keys; key += 2)
+                tree.Insert(key, std::make_shared<int>(key));
+            locked = Run(tree, keys, operations, threads, [&](BST<int, int>& tree, int key, int operation) {
+                std::lock_guard<std::mutex> guard(lock);
+                if (operation == 0)
+                    return (int)tree.TryEmplace(key, key).second;
+                if (operation == 1)
+                    return (int)(tree.Extract(key) != nullptr);
+                return (int)tree.Find(key);
+            });
+        }
+        std::printf("  %7d %12.2fM/s %10.1fMB %12.2fM/s\n", threads, concurrent, grown, locked);
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include <atomic>
+#include <memory>
+#include <thread>
+#include "../concurrentBST.h"
+#include "bench.h"
+
+/*
+* Correctness under contention, meant to be run under ThreadSanitizer
+* (make tsan). Every thread inserts and removes only the keys congruent to its
+* own index, so it knows what each of its calls has to return, and reads the
+* other threads' keys, whose values must always equal their key. Removed
+* values and unlinked nodes are reclaimed while the threads are running.
+*
+*     concurrentBSTStress [operations per thread = 200000] [threads = 8] [keys = 4096]
+*/
+typedef ConcurrentBST<int, int> Tree;
+
+int main(int argc, char** argv) {
+    int operations = ArgOr(argc, argv, 1, 200000);
+    int threads = ArgOr(argc, argv, 2, 8);
+    int keys = ArgOr(argc, argv, 3, 4096);
+    Tree tree;
+    std::atomic<int> failures(0);
+    std::atomic<int> present(0);
+
+    std::vector<std::thread> workers;
+    for (int w = 0; w < threads; w++) {
+        workers.emplace_back([&, w] {
+            uint64_t state = 0x9e3779b97f4a7c15ULL * (w + 1);
+            std::vector<char> mine(keys, 0);
+            for (int i = 0; i < operations; i++) {
+                uint64_t random = NextRandom(state);
+                int key = (int)(random >> 40) % keys;
+                int operation = (int)(random & 3);
+                if (key % threads != w)
+                    operation = 3;
+                if (operation == 0) {
+                    if (tree.Insert(key, std::make_shared<int>(key)) != !mine[key])
+                        failures++;
+                    mine[key] = 1;
+                }
+                else if (operation == 1) {
+                    std::shared_ptr<int> removed = tree.Extract(key);
+                    if ((removed != nullptr) != (mine[key] != 0) || (removed != nullptr && *removed != key))
+                        failures++;
+                    mine[key] = 0;
+                }
+                else {
+                    std::shared_ptr<int> found = tree.Get(key);
+                    if (found != nullptr && *found != key)
+                        failures++;
+                    if (key % threads == w && (found != nullptr) != (mine[key] != 0))
+                        failures++;
+                }
+            }
+            int count = 0;
+            for (char in : mine)
+                count += in;
+            present += count;
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+
+    if (tree.Size() != present.load())
+        failures++;
+    std::printf("concurrentBSTStress: %d threads x %d operations, %d keys left, %d failures\n",
+                threads, operations, tree.Size(), failures.load());
+    return failures.load() == 0 ? 0 : 1;
+}
@@ -0,0 +1,80 @@
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "../concurrentHashTable.h"
+#include "../hashtable.h"
+#include "bench.h"
+
+/*
+* Throughput of ConcurrentHashTable against a HashTable behind one mutex, from
+* one thread up to maxThreads. Lookups make up lookupPercent of the operations
+* and writes the rest, alternating between inserts and removes, over a key
+* range that starts half full.
+*
+*     concurrentHashOps [keys = 1000000] [operations = 4000000] [maxThreads = 64] [lookupPercent = 90]
+*/
+template <class Table, class Operation>
+static double Run(Table& table, int keys, int operations, int threads, Operation operation) {
+    std::vector<std::thread> workers;
+    double start = Seconds();
+    for (int w = 0; w < threads; w++) {
+        workers.emplace_back([&, w] {
+            uint64_t state = 0x9e3779b97f4a7c15ULL * (w + 1);
+            int found = 0;
+            for (int i = w; i < operations; i += threads) {
+                uint64_t random = NextRandom(state);
+                found += operation(table, (int)((random >> 32) % keys), (int)(random % 100));
+            }
+            Consume(found);
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+    return operations / (Seconds() - start) / 1e6;
+}
+
+int main(int argc, char** argv) {
+    int keys = ArgOr(argc, argv, 1, 1000000);
+    int operations = ArgOr(argc, argv, 2, 4000000);
+    int maxThreads = ArgOr(argc, argv, 3, 64);
+    int lookupPercent = ArgOr(argc, argv, 4, 90);
+    std::printf("concurrentHashOps: %d keys, %d operations, %d%% lookups, %u hardware threads\n",
+                keys, operations, lookupPercent, std::thread::hardware_concurrency());
+    std::printf("  %7s %20s %18s\n", "threads", "ConcurrentHashTable", "HashTable + mutex");
+
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        double sharded, locked;
+        {
+            ConcurrentHashTable<int, int> table;
+            table.Reserve(keys);
+            for (int key = 0; key < keys; key += 2)
+                table.Insert(key, std::make_shared<int>(key));
+            sharded = Run(table, keys, operations, threads, [&](ConcurrentHashTable<int, int>& table, int key, int operation) {
+                if (operation < lookupPercent)
+                    return (int)table.IfExists(key);
+                if (operation % 2 == 0)
+                    return (int)table.TryEmplace(key, key).second;
+                table.Remove(key);
+                return 0;
+            });
+        }
+        {
+            HashTable<int, int> table;
+            std::mutex lock;
+            table.Reserve(keys);
+            for (int key = 0; key < keys; key += 2)
+                table.Insert(key, std::make_shared<int>(key));
+            locked = Run(table, keys, operations, threads, [&](HashTable<int, int>& table, int key, int operation) {
+                std::lock_guard<std::mutex> guard(lock);
+                if (operation < lookupPercent)
+                    return (int)table.IfExists(key);
+                if (operation % 2 == 0)
+                    return (int)table.TryEmplace(key, key).second;
+                table.Remove(key);
+                return 0;
+            });
+        }
+        std::printf("  %7d %16.2fM/s %14.2fM/s\n", threads, sharded, locked);
+    }
+    return 0;
+}
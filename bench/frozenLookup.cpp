@@ -0,0 +1,43 @@
+#include <memory>
+#include "../BST.h"
+#include "../frozenBST.h"
+#include "bench.h"
+
+/*
+* Lookups per second on a live BST against its frozen Eytzinger snapshot, for
+* random keys that are half hits and half misses.
+*
+*     frozenLookup [size = 1000000] [lookups = 4000000]
+*/
+typedef BST<int, int, SlabNodePolicy> Tree;
+
+template <class Lookup>
+static void Time(const char* name, const std::vector<int>& probes, Lookup lookup) {
+    double start = Seconds();
+    int found = 0;
+    for (int key : probes)
+        found += lookup(key);
+    double elapsed = Seconds() - start;
+    Consume(found);
+    std::printf("  %-12s %7.2fM lookups/s  (%d found)\n", name, probes.size() / elapsed / 1e6, found);
+}
+
+int main(int argc, char** argv) {
+    int size = ArgOr(argc, argv, 1, 1000000);
+    int lookups = ArgOr(argc, argv, 2, 4000000);
+    std::vector<int> keys = RandomKeys(2 * size);
+    Tree tree;
+    for (int i = 0; i < size; i++)
+        tree.Insert(keys[i], std::make_shared<int>(keys[i]));
+    FrozenBST<int, int> frozen = tree.Freeze();
+
+    std::vector<int> probes(lookups);
+    uint64_t state = 2463534242ULL;
+    for (int i = 0; i < lookups; i++)
+        probes[i] = keys[NextRandom(state) % keys.size()];
+    std::printf("frozenLookup: %d keys, %d lookups\n", tree.size, lookups);
+
+    Time("BST", probes, [&](int key) { return tree.Find(key); });
+    Time("FrozenBST", probes, [&](int key) { return frozen.Find(key); });
+    return 0;
+}
@@ -0,0 +1,50 @@
+#include "../hashtable.h"
+#include "bench.h"
+
+/*
+* The slowest single Insert while a HashTable grows to n entries, reported
+* per range of sizes, in both resize modes. A blocking resize rehashes every
+* entry in one Insert, so its worst case grows with the table; an incremental
+* one should stay flat. Each Insert is timed over several identical runs and
+* its fastest time kept, so a preempted run does not show up as a slow Insert.
+*
+*     hashLatency [n = 4000000] [runs = 3]
+*/
+typedef HashTable<int, int, InlineValuePolicy, DefaultHash<int>, std::equal_to<int>, DefaultLoadPolicy, SlabNodePolicy> Table;
+
+static void Run(const char* name, Table::ResizeMode mode, const std::vector<int>& keys, int runs) {
+    std::vector<double> fastest(keys.size(), 1e9);
+    for (int run = 0; run < runs; run++) {
+        Table table(mode);
+        for (size_t i = 0; i < keys.size(); i++) {
+            double start = Seconds();
+            table.TryEmplace(keys[i], keys[i]);
+            double elapsed = Seconds() - start;
+            if (elapsed < fastest[i])
+                fastest[i] = elapsed;
+        }
+    }
+
+    std::printf("  %s\n", name);
+    double worst = 0;
+    size_t band = 10000;
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (fastest[i] > worst)
+            worst = fastest[i];
+        if (i + 1 == band || i + 1 == keys.size()) {
+            std::printf("    up to %9zu entries: worst Insert %9.1fus\n", i + 1, worst * 1e6);
+            worst = 0;
+            band *= 10;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    int n = ArgOr(argc, argv, 1, 4000000);
+    int runs = ArgOr(argc, argv, 2, 3);
+    std::vector<int> keys = RandomKeys(n);
+    std::printf("hashLatency: %d random keys\n", n);
+    Run("BLOCKING_RESIZE", Table::BLOCKING_RESIZE, keys, runs);
+    Run("INCREMENTAL_RESIZE", Table::INCREMENTAL_RESIZE, keys, runs);
+    return 0;
+}
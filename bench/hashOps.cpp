@@ -0,0 +1,47 @@
+#include <memory>
+#include "../hashtable.h"
+#include "bench.h"
+
+/*
+* Per-operation cost of HashTable: Insert, TryEmplace of new and of present
+* keys, Get of present and of absent keys, and Remove.
+*
+*     hashOps [n = 1000000]
+*/
+typedef HashTable<int, int> Table;
+
+template <class Operation>
+static void Time(const char* name, const std::vector<int>& keys, Operation operation) {
+    double start = Seconds();
+    long result = 0;
+    for (int key : keys)
+        result += operation(key);
+    double elapsed = Seconds() - start;
+    Consume(result);
+    std::printf("  %-22s %7.1fns/op\n", name, elapsed * 1e9 / keys.size());
+}
+
+int main(int argc, char** argv) {
+    int n = ArgOr(argc, argv, 1, 1000000);
+    std::vector<int> keys = RandomKeys(n);
+    std::vector<int> absent = RandomKeys(n, 0x5851f42d4c957f2dULL);
+    std::printf("hashOps: %d random keys\n", n);
+
+    {
+        Table table;
+        Time("Insert", keys, [&](int key) {
+            table.Insert(key, std::make_shared<int>(key));
+            return 0;
+        });
+    }
+    Table table;
+    Time("TryEmplace, new", keys, [&](int key) { return (long)table.TryEmplace(key, key).second; });
+    Time("TryEmplace, present", keys, [&](int key) { return (long)table.TryEmplace(key, key).second; });
+    Time("Get, present", keys, [&](int key) { return (long)(table.Get(key) != nullptr); });
+    Time("Get, absent", absent, [&](int key) { return (long)(table.Get(key) != nullptr); });
+    Time("Remove", keys, [&](int key) {
+        table.Remove(key);
+        return 0;
+    });
+    return 0;
+}
@@ -0,0 +1,50 @@
+#ifndef COMPARE_H_
+#define COMPARE_H_
+
+/*
+* Key ordering policies for BST and FrozenBST. A policy provides
+*     template <class A, class B> static int Order(const A& a, const B& b);
+* returning a negative number, zero or a positive number when a orders before,
+* with or after b, so a search step costs one comparison instead of the
+* (== then <) pair. The tree always passes its stored key as a.
+* A policy that also declares
+*     typedef void is_transparent;
+* lets lookups take any type it can order against keyT (std::string_view or
+* const char* against std::string keys) without building a temporary key.
+*
+* DefaultCompare uses a.compare(b) when the key type has one (std::string and
+* friends) and operator< otherwise, and is transparent.
+* LessCompare<Less> adapts an ordinary less-than predicate.
+*/
+struct DefaultCompare {
+    typedef void is_transparent;
+
+    template <class A, class B>
+    static int Order(const A& a, const B& b) {
+        return ThreeWay(a, b, 0);
+    }
+
+    private:
+        template <class A, class B>
+        static auto ThreeWay(const A& a, const B& b, int) -> decltype(static_cast<int>(a.compare(b))) {
+            return a.compare(b);
+        }
+
+        template <class A, class B>
+        static int ThreeWay(const A& a, const B& b, long) {
+            return (b < a) - (a < b);
+        }
+};
+
+template <class Less>
+struct LessCompare {
+    template <class A, class B>
+    static int Order(const A& a, const B& b) {
+        Less less;
+        if (less(a, b))
+            return -1;
+        return less(b, a) ? 1 : 0;
+    }
+};
+
+#endif /* COMPARE_H_ */
@@ -0,0 +1,882 @@
+#ifndef CONCURRENT_BST_H_
+#define CONCURRENT_BST_H_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+* ConcurrentBST - a relaxed-balance AVL tree that many threads can use at once,
+* after Bronson, Casper, Chafi and Olukotun, "A Practical Concurrent Binary
+* Search Tree" (PPoPP 2010).
+*
+* Lookups take no locks. Every node carries a version that a rotation bumps
+* when it moves the node down (shrinks its key range); a reader validates the
+* version of the node it came from after reading a child link and retries from
+* there if it changed. Insert and Remove lock only the nodes they relink, and
+* rebalancing locks a parent, a node and at most two of its descendants,
+* always top down.
+*
+* Removing a key with two children leaves a routing node (no value) in place,
+* which rebalancing unlinks once it has fewer than two children. Unlinked nodes
+* and removed values can still be in use by a concurrent reader, so they are
+* reclaimed by epochs: every operation pins the global epoch it started in, a
+* retired object goes into a bag tagged with the epoch it was retired in, and
+* the epoch only moves on once every pinned operation has seen the current
+* one. A bag is freed two epochs later, when no operation that could have
+* reached its objects is still running.
+*/
+template <class keyT, class dataT>
+class ConcurrentBST {
+    private:
+        struct Value {
+            std::shared_ptr<dataT> data;
+            Value* retiredNext;
+
+            explicit Value(const std::shared_ptr<dataT>& data) : data(data), retiredNext(nullptr) {}
+        };
+
+        struct Node {
+            const keyT key;
+            std::atomic<int> height;
+            std::atomic<long> version;
+            std::atomic<Value*> value;
+            std::atomic<Node*> parent;
+            std::atomic<Node*> left;
+            std::atomic<Node*> right;
+            std::mutex lock;
+            Node* retiredNext;
+
+            Node(const keyT& key, int height, Value* value, Node* parent) :
+                key(key), height(height), version(0), value(value), parent(parent), left(nullptr), right(nullptr), retiredNext(nullptr) {}
+
+            std::atomic<Node*>& Child(int dir) {
+                return dir < 0 ? left : right;
+            }
+        };
+
+        //version bits: the node was unlinked, a rotation is moving it down, and a change counter above them
+        static const long UNLINKED = 1;
+        static const long SHRINKING = 2;
+        static const long SHRINK_COUNT = 4;
+
+        //NodeCondition returns the height a node should have, or one of these
+        static const int NOTHING_REQUIRED = -1;
+        static const int UNLINK_REQUIRED = -2;
+        static const int REBALANCE_REQUIRED = -3;
+
+        static const int SPIN_LIMIT = 100;
+
+        //operations that can run at once without waiting for a reservation, and retires between epoch advances
+        static const int RESERVATIONS = 64;
+        static const int ADVANCE_EVERY = 64;
+        static const int BAGS = 3;
+
+        //Claimed by one operation at a time; the bags belong to whoever holds it.
+        struct alignas(64) Reservation {
+            std::atomic<unsigned long> epoch;   //0 while no operation holds it
+            Node* nodes[BAGS];
+            Value* values[BAGS];
+            unsigned long bagEpoch[BAGS];
+            int retired;
+
+            Reservation() : epoch(0), nodes(), values(), bagEpoch(), retired(0) {}
+        };
+
+        //Pins the current epoch for the lifetime of an operation.
+        class Pin {
+            private:
+                Reservation* reservation;
+                Reservation* outer;
+
+            public:
+                explicit Pin(const ConcurrentBST<keyT, dataT>& tree);
+                Pin(const Pin& copy) = delete;
+                Pin& operator=(const Pin& copy) = delete;
+                ~Pin();
+        };
+
+        static thread_local Reservation* pinned;
+
+        enum Result { DONE, RETRY };
+
+        //the tree hangs off the right link of this sentinel, whose version never changes
+        Node holder;
+        std::atomic<int> size;
+        mutable std::atomic<unsigned long> epoch;
+        mutable Reservation reservations[RESERVATIONS];
+
+        static int Compare(const keyT& key, const keyT& other);
+        static int Height(const Node* node);
+        static int IntMax(int a, int b);
+        static void WaitUntilNotShrinking(Node* node);
+        Result AttemptGet(const keyT& key, Node* node, int dir, long nodeV, Value** found) const;
+        Result AttemptInsert(const keyT& key, const std::shared_ptr<dataT>& data, Node* node, int dir, long nodeV, bool* inserted);
+        Result AttemptLink(const keyT& key, const std::shared_ptr<dataT>& data, Node* node, int dir, long nodeV);
+        Result AttemptRevive(Node* node, const std::shared_ptr<dataT>& data, bool* inserted);
+        Result AttemptRemove(const keyT& key, Node* node, int dir, long nodeV, Value** removed);
+        Result AttemptRemoveNode(Node* parent, Node* node, Value** removed);
+        bool AttemptUnlink(Node* parent, Node* node);
+        void FixHeightAndRebalance(Node* node);
+        static int NodeCondition(Node* node);
+        static Node* FixHeight(Node* node);
+        Node* Rebalance(Node* parent, Node* node);
+        Node* RebalanceToRight(Node* parent, Node* node, Node* left, int rightHeight);
+        Node* RebalanceToLeft(Node* parent, Node* node, Node* right, int leftHeight);
+        static Node* RotateRight(Node* parent, Node* node, Node* left, int hR, int hLL, Node* leftRight, int hLR);
+        static Node* RotateLeft(Node* parent, Node* node, int hL, Node* right, Node* rightLeft, int hRL, int hRR);
+        static Node* RotateRightOverLeft(Node* parent, Node* node, Node* left, int hR, int hLL, Node* leftRight, int hLRL);
+        static Node* RotateLeftOverRight(Node* parent, Node* node, int hL, Node* right, Node* rightLeft, int hRR, int hRLR);
+        void Retire(Node* node);
+        void Retire(Value* value);
+        int Bag(Reservation& reservation);
+        void TryAdvance();
+        static void Free(Reservation& reservation, int bag);
+
+    public:
+        ConcurrentBST() : holder(keyT(), 0, nullptr, nullptr), size(0), epoch(1) {}
+        ConcurrentBST(const ConcurrentBST<keyT, dataT>& copy) = delete;
+        ConcurrentBST<keyT, dataT>& operator=(const ConcurrentBST<keyT, dataT>& copy) = delete;
+        ~ConcurrentBST();
+
+        std::shared_ptr<dataT> Get(const keyT& target) const;
+        bool Find(const keyT& target) const;
+        //Adds key if it is absent; returns whether it was added.
+        bool Insert(const keyT& key, const std::shared_ptr<dataT>& data);
+        void Remove(const keyT& key);
+        std::shared_ptr<dataT> Extract(const keyT& key);
+        int Size() const {
+            return size.load();
+        }
+        //Frees every retired node and value right away; no other thread may be using the tree.
+        void FreeRetired();
+};
+
+template <class keyT, class dataT>
+ConcurrentBST<keyT, dataT>::~ConcurrentBST()
+{
+    std::vector<Node*> stack;
+    Node* root = holder.right.load();
+    if (root != nullptr)
+        stack.push_back(root);
+    while (!stack.empty()) {
+        Node* node = stack.back();
+        stack.pop_back();
+        if (node->left.load() != nullptr)
+            stack.push_back(node->left.load());
+        if (node->right.load() != nullptr)
+            stack.push_back(node->right.load());
+        delete node->value.load();
+        delete node;
+    }
+    FreeRetired();
+}
+
+template <class keyT, class dataT>
+thread_local typename ConcurrentBST<keyT, dataT>::Reservation* ConcurrentBST<keyT, dataT>::pinned = nullptr;
+
+//Claims a free reservation, starting from one that is this thread's own unless more threads than RESERVATIONS share the tree.
+template <class keyT, class dataT>
+ConcurrentBST<keyT, dataT>::Pin::Pin(const ConcurrentBST<keyT, dataT>& tree) : reservation(nullptr), outer(pinned)
+{
+    static std::atomic<int> threads(0);
+    static thread_local int first = threads++ % RESERVATIONS;
+    for (int i = first; reservation == nullptr; i = (i + 1) % RESERVATIONS) {
+        Reservation& candidate = tree.reservations[i];
+        unsigned long free = 0;
+        if (candidate.epoch.load() == 0 && candidate.epoch.compare_exchange_strong(free, tree.epoch.load()))
+            reservation = &candidate;
+        else if ((i + 1) % RESERVATIONS == first)
+            std::this_thread::yield();
+    }
+    pinned = reservation;
+}
+
+template <class keyT, class dataT>
+ConcurrentBST<keyT, dataT>::Pin::~Pin()
+{
+    pinned = outer;
+    reservation->epoch.store(0);
+}
+
+template <class keyT, class dataT>
+void ConcurrentBST<keyT, dataT>::FreeRetired()
+{
+    for (Reservation& reservation : reservations) {
+        for (int bag = 0; bag < BAGS; bag++)
+            Free(reservation, bag);
+    }
+}
+
+template <class keyT, class dataT>
+void ConcurrentBST<keyT, dataT>::Free(Reservation& reservation, int bag)
+{
+    Node* node = reservation.nodes[bag];
+    while (node != nullptr) {
+        Node* next = node->retiredNext;
+        delete node;
+        node = next;
+    }
+    Value* value = reservation.values[bag];
+    while (value != nullptr) {
+        Value* next = value->retiredNext;
+        delete value;
+        value = next;
+    }
+    reservation.nodes[bag] = nullptr;
+    reservation.values[bag] = nullptr;
+}
+
+//The epoch moves on only once every operation still running has pinned the current one.
+template <class keyT, class dataT>
+void ConcurrentBST<keyT, dataT>::TryAdvance()
+{
+    unsigned long current = epoch.load();
+    for (Reservation& reservation : reservations) {
+        unsigned long pinnedAt = reservation.epoch.load();
+        if (pinnedAt != 0 && pinnedAt != current)
+            return;
+    }
+    epoch.compare_exchange_strong(current, current + 1);
+}
+
+//Returns the bag for the current epoch, after freeing the bags at least two epochs old.
+template <class keyT, class dataT>
+int ConcurrentBST<keyT, dataT>::Bag(Reservation& reservation)
+{
+    if (++reservation.retired % ADVANCE_EVERY == 0)
+        TryAdvance();
+    unsigned long current = epoch.load();
+    for (int bag = 0; bag < BAGS; bag++) {
+        if (reservation.bagEpoch[bag] + 2 <= current)
+            Free(reservation, bag);
+    }
+    int bag = current % BAGS;
+    reservation.bagEpoch[bag] = current;
+    return bag;
+}
+
+template <class keyT, class dataT>
+void ConcurrentBST<keyT, dataT>::Retire(Node* node)
+{
+    Reservation& reservation = *pinned;
+    int bag = Bag(reservation);
+    node->retiredNext = reservation.nodes[bag];
+    reservation.nodes[bag] = node;
+}
+
+template <class keyT, class dataT>
+void ConcurrentBST<keyT, dataT>::Retire(Value* value)
+{
+    Reservation& reservation = *pinned;
+    int bag = Bag(reservation);
+    value->retiredNext = reservation.values[bag];
+    reservation.values[bag] = value;
+}
+
+template <class keyT, class dataT>
+int ConcurrentBST<keyT, dataT>::Compare(const keyT& key, const keyT& other)
+{
+    if (key == other)
+        return 0;
+    return key < other ? -1 : 1;
+}
+
+template <class keyT, class dataT>
+int ConcurrentBST<keyT, dataT>::Height(const Node* node)
+{
+    return node == nullptr ? 0 : node->height.load();
+}
+
+template <class keyT, class dataT>
+int ConcurrentBST<keyT, dataT>::IntMax(int a, int b)
+{
+    return a > b ? a : b;
+}
+
+//Spins (yielding after a while) rather than blocking on the rotating thread's locks.
+template <class keyT, class dataT>
+void ConcurrentBST<keyT, dataT>::WaitUntilNotShrinking(Node* node)
+{
+    for (int spins = 0; node->version.load() & SHRINKING; spins++) {
+        if (spins >= SPIN_LIMIT)
+            std::this_thread::yield();
+    }
+}
+
+template <class keyT, class dataT>
+std::shared_ptr<dataT> ConcurrentBST<keyT, dataT>::Get(const keyT& target) const
+{
+    Pin pin(*this);
+    Value* found = nullptr;
+    while (AttemptGet(target, const_cast<Node*>(&holder), 1, 0, &found) == RETRY);
+    if (found == nullptr)
+        return nullptr;
+    return found->data;
+}
+
+template <class keyT, class dataT>
+bool ConcurrentBST<keyT, dataT>::Find(const keyT& target) const
+{
+    Pin pin(*this);
+    Value* found = nullptr;
+    while (AttemptGet(target, const_cast<Node*>(&holder), 1, 0, &found) == RETRY);
+    return found != nullptr;
+}
+
+/*
+* Looks for key below node->Child(dir), where nodeV is the version node had when
+* we decided to descend into it. Once node has changed since then, the subtree
+* might no longer cover key and the caller has to retry one level up.
+*/
+template <class keyT, class dataT>
+typename ConcurrentBST<keyT, dataT>::Result ConcurrentBST<keyT, dataT>::AttemptGet(const keyT& key, Node* node, int dir,
+                                                                                   long nodeV, Value** found) const
+{
+    while (true) {
+        Node* child = node->Child(dir).load();
+        if (node->version.load() != nodeV)
+            return RETRY;
+        if (child == nullptr) {
+            *found = nullptr;
+            return DONE;
+        }
+
+        int nextDir = Compare(key, child->key);
+        if (nextDir == 0) {
+            *found = child->value.load();
+            return DONE;
+        }
+
+        long childV = child->version.load();
+        if (childV & SHRINKING)
+            WaitUntilNotShrinking(child);
+        else if (childV != UNLINKED && child == node->Child(dir).load()) {
+            if (node->version.load() != nodeV)
+                return RETRY;
+            if (AttemptGet(key, child, nextDir, childV, found) == DONE)
+                return DONE;
+        }
+    }
+}
+
+template <class keyT, class dataT>
+bool ConcurrentBST<keyT, dataT>::Insert(const keyT& key, const std::shared_ptr<dataT>& data)
+{
+    Pin pin(*this);
+    bool inserted = false;
+    while (AttemptInsert(key, data, &holder, 1, 0, &inserted) == RETRY);
+    if (inserted)
+        size++;
+    return inserted;
+}
+
+template <class keyT, class dataT>
+typename ConcurrentBST<keyT, dataT>::Result ConcurrentBST<keyT, dataT>::AttemptInsert(const keyT& key, const std::shared_ptr<dataT>& data,
+                                                                                      Node* node, int dir, long nodeV, bool* inserted)
+{
+    while (true) {
+        Node* child = node->Child(dir).load();
+        if (node->version.load() != nodeV)
+            return RETRY;
+
+        Result result = RETRY;
+        if (child == nullptr) {
+            result = AttemptLink(key, data, node, dir, nodeV);
+            *inserted = result == DONE;
+        }
+        else {
+            int nextDir = Compare(key, child->key);
+            if (nextDir == 0)
+                result = AttemptRevive(child, data, inserted);
+            else {
+                long childV = child->version.load();
+                if (childV & SHRINKING)
+                    WaitUntilNotShrinking(child);
+                else if (childV != UNLINKED && child == node->Child(dir).load()) {
+                    if (node->version.load() != nodeV)
+                        return RETRY;
+                    result = AttemptInsert(key, data, child, nextDir, childV, inserted);
+                }
+            }
+        }
+        if (result == DONE)
+            return DONE;
+    }
+}
+
+template <class keyT, class dataT>
+typename ConcurrentBST<keyT, dataT>::Result ConcurrentBST<keyT, dataT>::AttemptLink(const keyT& key, const std::shared_ptr<dataT>& data,
+                                                                                    Node* node, int dir, long nodeV)
+{
+    {
+        std::lock_guard<std::mutex> guard(node->lock);
+        if (node->version.load() != nodeV || node->Child(dir).load() != nullptr)
+            return RETRY;
+        node->Child(dir).store(new Node(key, 1, new Value(data), node));
+    }
+    FixHeightAndRebalance(node);
+    return DONE;
+}
+
+//Gives a routing node for key its value back.
+template <class keyT, class dataT>
+typename ConcurrentBST<keyT, dataT>::Result ConcurrentBST<keyT, dataT>::AttemptRevive(Node* node, const std::shared_ptr<dataT>& data,
+                                                                                      bool* inserted)
+{
+    if (node->value.load() != nullptr) {
+        *inserted = false;
+        return DONE;
+    }
+    std::lock_guard<std::mutex> guard(node->lock);
+    if (node->version.load() == UNLINKED)
+        return RETRY;
+    *inserted = node->value.load() == nullptr;
+    if (*inserted)
+        node->value.store(new Value(data));
+    return DONE;
+}
+
+template <class keyT, class dataT>
+void ConcurrentBST<keyT, dataT>::Remove(const keyT& key)
+{
+    Extract(key);
+}
+
+template <class keyT, class dataT>
+std::shared_ptr<dataT> ConcurrentBST<keyT, dataT>::Extract(const keyT& key)
+{
+    Pin pin(*this);
+    Value* removed = nullptr;
+    while (AttemptRemove(key, &holder, 1, 0, &removed) == RETRY);
+    if (removed == nullptr)
+        return nullptr;
+    size--;
+    std::shared_ptr<dataT> data = removed->data;
+    Retire(removed);
+    return data;
+}
+
+template <class keyT, class dataT>
+typename ConcurrentBST<keyT, dataT>::Result ConcurrentBST<keyT, dataT>::AttemptRemove(const keyT& key, Node* node, int dir,
+                                                                                      long nodeV, Value** removed)
+{
+    while (true) {
+        Node* child = node->Child(dir).load();
+        if (node->version.load() != nodeV)
+            return RETRY;
+        if (child == nullptr) {
+            *removed = nullptr;
+            return DONE;
+        }
+
+        Result result = RETRY;
+        int nextDir = Compare(key, child->key);
+        if (nextDir == 0)
+            result = AttemptRemoveNode(node, child, removed);
+        else {
+            long childV = child->version.load();
+            if (childV & SHRINKING)
+                WaitUntilNotShrinking(child);
+            else if (childV != UNLINKED && child == node->Child(dir).load()) {
+                if (node->version.load() != nodeV)
+                    return RETRY;
+                result = AttemptRemove(key, child, nextDir, childV, removed);
+            }
+        }
+        if (result == DONE)
+            return DONE;
+    }
+}
+
+//A node with fewer than two children is unlinked; otherwise it becomes a routing node.
+template <class keyT, class dataT>
+typename ConcurrentBST<keyT, dataT>::Result ConcurrentBST<keyT, dataT>::AttemptRemoveNode(Node* parent, Node* node, Value** removed)
+{
+    if (node->value.load() == nullptr) {
+        *removed = nullptr;
+        return DONE;
+    }
+
+    if (node->left.load() == nullptr || node->right.load() == nullptr) {
+        {
+            std::lock_guard<std::mutex> parentGuard(parent->lock);
+            if (parent->version.load() == UNLINKED || node->parent.load() != parent)
+                return RETRY;
+            std::lock_guard<std::mutex> guard(node->lock);
+            *removed = node->value.load();
+            if (*removed == nullptr)
+                return DONE;
+            if (!AttemptUnlink(parent, node))
+                return RETRY;
+        }
+        FixHeightAndRebalance(parent);
+        return DONE;
+    }
+
+    std::lock_guard<std::mutex> guard(node->lock);
+    if (node->version.load() == UNLINKED || node->left.load() == nullptr || node->right.load() == nullptr)
+        return RETRY;
+    *removed = node->value.load();
+    node->value.store(nullptr);
+    return DONE;
+}
+
+//Both parent and node are locked.
+template <class keyT, class dataT>
+bool ConcurrentBST<keyT, dataT>::AttemptUnlink(Node* parent, Node* node)
+{
+    Node* parentLeft = parent->left.load();
+    Node* parentRight = parent->right.load();
+    if (parentLeft != node && parentRight != node)
+        return false;
+
+    Node* left = node->left.load();
+    Node* right = node->right.load();
+    if (left != nullptr && right != nullptr)
+        return false;
+
+    Node* splice = left != nullptr ? left : right;
+    if (parentLeft == node)
+        parent->left.store(splice);
+    else
+        parent->right.store(splice);
+    if (splice != nullptr)
+        splice->parent.store(parent);
+
+    node->version.store(UNLINKED);
+    node->value.store(nullptr);
+    Retire(node);
+    return true;
+}
+
+template <class keyT, class dataT>
+int ConcurrentBST<keyT, dataT>::NodeCondition(Node* node)
+{
+    Node* left = node->left.load();
+    Node* right = node->right.load();
+    if ((left == nullptr || right == nullptr) && node->value.load() == nullptr)
+        return UNLINK_REQUIRED;
+
+    int height = node->height.load();
+    int leftHeight = Height(left);
+    int rightHeight = Height(right);
+    int newHeight = 1 + IntMax(leftHeight, rightHeight);
+    int balance = leftHeight - rightHeight;
+    if (balance < -1 || balance > 1)
+        return REBALANCE_REQUIRED;
+    return height != newHeight ? newHeight : NOTHING_REQUIRED;
+}
+
+/*
+* Walks from node up to the root repairing heights and balance. A rotation can
+* leave work both below it and at its parent, and only the lower one is handed
+* back, so the walk does not stop at the first node that is already fine.
+*/
+template <class keyT, class dataT>
+void ConcurrentBST<keyT, dataT>::FixHeightAndRebalance(Node* node)
+{
+    while (node != nullptr && node->parent.load() != nullptr) {
+        int condition = NodeCondition(node);
+        if (node->version.load() == UNLINKED)
+            return;
+
+        if (condition == NOTHING_REQUIRED)
+            node = node->parent.load();
+        else if (condition != UNLINK_REQUIRED && condition != REBALANCE_REQUIRED) {
+            std::lock_guard<std::mutex> guard(node->lock);
+            node = FixHeight(node);
+        }
+        else {
+            Node* parent = node->parent.load();
+            std::lock_guard<std::mutex> parentGuard(parent->lock);
+            if (parent->version.load() != UNLINKED && node->parent.load() == parent) {
+                std::lock_guard<std::mutex> guard(node->lock);
+                node = Rebalance(parent, node);
+            }
+        }
+    }
+}
+
+//node is locked. Returns the next node to look at.
+template <class keyT, class dataT>
+typename ConcurrentBST<keyT, dataT>::Node* ConcurrentBST<keyT, dataT>::FixHeight(Node* node)
+{
+    int condition = NodeCondition(node);
+    if (condition == REBALANCE_REQUIRED || condition == UNLINK_REQUIRED)
+        return node;
+    if (condition != NOTHING_REQUIRED)
+        node->height.store(condition);
+    return node->parent.load();
+}
+
+//parent and node are locked.
+template <class keyT, class dataT>
+typename ConcurrentBST<keyT, dataT>::Node* ConcurrentBST<keyT, dataT>::Rebalance(Node* parent, Node* node)
+{
+    Node* left = node->left.load();
+    Node* right = node->right.load();
+    if ((left == nullptr || right == nullptr) && node->value.load() == nullptr) {
+        if (AttemptUnlink(parent, node))
+            return FixHeight(parent);
+        return node;
+    }
+
+    int height = node->height.load();
+    int leftHeight = Height(left);
+    int rightHeight = Height(right);
+    int newHeight = 1 + IntMax(leftHeight, rightHeight);
+    int balance = leftHeight - rightHeight;
+
+    if (balance > 1)
+        return RebalanceToRight(parent, node, left, rightHeight);
+    if (balance < -1)
+        return RebalanceToLeft(parent, node, right, leftHeight);
+    if (newHeight != height) {
+        node->height.store(newHeight);
+        return FixHeight(parent);
+    }
+    return parent;
+}
+
+template <class keyT, class dataT>
+typename ConcurrentBST<keyT, dataT>::Node* ConcurrentBST<keyT, dataT>::RebalanceToRight(Node* parent, Node* node, Node* left, int hR)
+{
+    std::lock_guard<std::mutex> leftGuard(left->lock);
+    int hL = left->height.load();
+    if (hL - hR <= 1)
+        return node;
+
+    Node* leftRight = left->right.load();
+    int hLL = Height(left->left.load());
+    int hLR = Height(leftRight);
+    if (hLL >= hLR)
+        return RotateRight(parent, node, left, hR, hLL, leftRight, hLR);
+
+    {
+        std::lock_guard<std::mutex> leftRightGuard(leftRight->lock);
+        hLR = leftRight->height.load();
+        if (hLL >= hLR)
+            return RotateRight(parent, node, left, hR, hLL, leftRight, hLR);
+
+        int hLRL = Height(leftRight->left.load());
+        int balance = hLL - hLRL;
+        if (balance >= -1 && balance <= 1)
+            return RotateRightOverLeft(parent, node, left, hR, hLL, leftRight, hLRL);
+    }
+    //left's right-left grandchild is too tall for a double rotation, straighten left first
+    return RebalanceToLeft(node, left, leftRight, hLL);
+}
+
+template <class keyT, class dataT>
+typename ConcurrentBST<keyT, dataT>::Node* ConcurrentBST<keyT, dataT>::RebalanceToLeft(Node* parent, Node* node, Node* right, int hL)
+{
+    std::lock_guard<std::mutex> rightGuard(right->lock);
+    int hR = right->height.load();
+    if (hL - hR >= -1)
+        return node;
+
+    Node* rightLeft = right->left.load();
+    int hRL = Height(rightLeft);
+    int hRR = Height(right->right.load());
+    if (hRR >= hRL)
+        return RotateLeft(parent, node, hL, right, rightLeft, hRL, hRR);
+
+    {
+        std::lock_guard<std::mutex> rightLeftGuard(rightLeft->lock);
+        hRL = rightLeft->height.load();
+        if (hRR >= hRL)
+            return RotateLeft(parent, node, hL, right, rightLeft, hRL, hRR);
+
+        int hRLR = Height(rightLeft->right.load());
+        int balance = hRR - hRLR;
+        if (balance >= -1 && balance <= 1)
+            return RotateLeftOverRight(parent, node, hL, right, rightLeft, hRR, hRLR);
+    }
+    return RebalanceToRight(node, right, rightLeft, hRR);
+}
+
+template <class keyT, class dataT>
+typename ConcurrentBST<keyT, dataT>::Node* ConcurrentBST<keyT, dataT>::RotateRight(Node* parent, Node* node, Node* left,
+                                                                                   int hR, int hLL, Node* leftRight, int hLR)
+{
+    long nodeV = node->version.load();
+    Node* parentLeft = parent->left.load();
+    node->version.store(nodeV | SHRINKING);
+
+    node->left.store(leftRight);
+    if (leftRight != nullptr)
+        leftRight->parent.store(node);
+    left->right.store(node);
+    node->parent.store(left);
+    if (parentLeft == node)
+        parent->left.store(left);
+    else
+        parent->right.store(left);
+    left->parent.store(parent);
+
+    int hNode = 1 + IntMax(hLR, hR);
+    node->height.store(hNode);
+    left->height.store(1 + IntMax(hLL, hNode));
+
+    node->version.store(nodeV + SHRINK_COUNT);
+
+    int balanceNode = hLR - hR;
+    if (balanceNode < -1 || balanceNode > 1)
+        return node;
+    if ((leftRight == nullptr || hR == 0) && node->value.load() == nullptr)
+        return node;
+    int balanceLeft = hLL - hNode;
+    if (balanceLeft < -1 || balanceLeft > 1)
+        return left;
+    if (hLL == 0 && left->value.load() == nullptr)
+        return left;
+    return FixHeight(parent);
+}
+
+template <class keyT, class dataT>
+typename ConcurrentBST<keyT, dataT>::Node* ConcurrentBST<keyT, dataT>::RotateLeft(Node* parent, Node* node, int hL, Node* right,
+                                                                                  Node* rightLeft, int hRL, int hRR)
+{
+    long nodeV = node->version.load();
+    Node* parentLeft = parent->left.load();
+    node->version.store(nodeV | SHRINKING);
+
+    node->right.store(rightLeft);
+    if (rightLeft != nullptr)
+        rightLeft->parent.store(node);
+    right->left.store(node);
+    node->parent.store(right);
+    if (parentLeft == node)
+        parent->left.store(right);
+    else
+        parent->right.store(right);
+    right->parent.store(parent);
+
+    int hNode = 1 + IntMax(hL, hRL);
+    node->height.store(hNode);
+    right->height.store(1 + IntMax(hNode, hRR));
+
+    node->version.store(nodeV + SHRINK_COUNT);
+
+    int balanceNode = hRL - hL;
+    if (balanceNode < -1 || balanceNode > 1)
+        return node;
+    if ((rightLeft == nullptr || hL == 0) && node->value.load() == nullptr)
+        return node;
+    int balanceRight = hRR - hNode;
+    if (balanceRight < -1 || balanceRight > 1)
+        return right;
+    if (hRR == 0 && right->value.load() == nullptr)
+        return right;
+    return FixHeight(parent);
+}
+
+template <class keyT, class dataT>
+typename ConcurrentBST<keyT, dataT>::Node* ConcurrentBST<keyT, dataT>::RotateRightOverLeft(Node* parent, Node* node, Node* left,
+                                                                                           int hR, int hLL, Node* leftRight, int hLRL)
+{
+    long nodeV = node->version.load();
+    long leftV = left->version.load();
+    Node* parentLeft = parent->left.load();
+    Node* leftRightLeft = leftRight->left.load();
+    Node* leftRightRight = leftRight->right.load();
+    int hLRR = Height(leftRightRight);
+
+    node->version.store(nodeV | SHRINKING);
+    left->version.store(leftV | SHRINKING);
+
+    node->left.store(leftRightRight);
+    if (leftRightRight != nullptr)
+        leftRightRight->parent.store(node);
+    left->right.store(leftRightLeft);
+    if (leftRightLeft != nullptr)
+        leftRightLeft->parent.store(left);
+    leftRight->left.store(left);
+    left->parent.store(leftRight);
+    leftRight->right.store(node);
+    node->parent.store(leftRight);
+    if (parentLeft == node)
+        parent->left.store(leftRight);
+    else
+        parent->right.store(leftRight);
+    leftRight->parent.store(parent);
+
+    int hNode = 1 + IntMax(hLRR, hR);
+    node->height.store(hNode);
+    int hLeft = 1 + IntMax(hLL, hLRL);
+    left->height.store(hLeft);
+    leftRight->height.store(1 + IntMax(hLeft, hNode));
+
+    node->version.store(nodeV + SHRINK_COUNT);
+    left->version.store(leftV + SHRINK_COUNT);
+
+    int balanceNode = hLRR - hR;
+    if (balanceNode < -1 || balanceNode > 1)
+        return node;
+    if ((leftRightRight == nullptr || hR == 0) && node->value.load() == nullptr)
+        return node;
+    //a routing node left with one child has to be unlinked before it can settle
+    if ((hLL == 0 || leftRightLeft == nullptr) && left->value.load() == nullptr)
+        return left;
+    int balanceLeftRight = hLeft - hNode;
+    if (balanceLeftRight < -1 || balanceLeftRight > 1)
+        return leftRight;
+    return FixHeight(parent);
+}
+
+template <class keyT, class dataT>
+typename ConcurrentBST<keyT, dataT>::Node* ConcurrentBST<keyT, dataT>::RotateLeftOverRight(Node* parent, Node* node, int hL, Node* right,
+                                                                                           Node* rightLeft, int hRR, int hRLR)
+{
+    long nodeV = node->version.load();
+    long rightV = right->version.load();
+    Node* parentLeft = parent->left.load();
+    Node* rightLeftLeft = rightLeft->left.load();
+    Node* rightLeftRight = rightLeft->right.load();
+    int hRLL = Height(rightLeftLeft);
+
+    node->version.store(nodeV | SHRINKING);
+    right->version.store(rightV | SHRINKING);
+
+    node->right.store(rightLeftLeft);
+    if (rightLeftLeft != nullptr)
+        rightLeftLeft->parent.store(node);
+    right->left.store(rightLeftRight);
+    if (rightLeftRight != nullptr)
+        rightLeftRight->parent.store(right);
+    rightLeft->right.store(right);
+    right->parent.store(rightLeft);
+    rightLeft->left.store(node);
+    node->parent.store(rightLeft);
+    if (parentLeft == node)
+        parent->left.store(rightLeft);
+    else
+        parent->right.store(rightLeft);
+    rightLeft->parent.store(parent);
+
+    int hNode = 1 + IntMax(hL, hRLL);
+    node->height.store(hNode);
+    int hRight = 1 + IntMax(hRLR, hRR);
+    right->height.store(hRight);
+    rightLeft->height.store(1 + IntMax(hNode, hRight));
+
+    node->version.store(nodeV + SHRINK_COUNT);
+    right->version.store(rightV + SHRINK_COUNT);
+
+    int balanceNode = hRLL - hL;
+    if (balanceNode < -1 || balanceNode > 1)
+        return node;
+    if ((rightLeftLeft == nullptr || hL == 0) && node->value.load() == nullptr)
+        return node;
+    if ((hRR == 0 || rightLeftRight == nullptr) && right->value.load() == nullptr)
+        return right;
+    int balanceRightLeft = hRight - hNode;
+    if (balanceRightLeft < -1 || balanceRightLeft > 1)
+        return rightLeft;
+    return FixHeight(parent);
+}
+
+#endif /* CONCURRENT_BST_H_ */
@@ -0,0 +1,184 @@
+#ifndef CONCURRENT_HASH_TABLE_H_
+#define CONCURRENT_HASH_TABLE_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
+#include "hash.h"
+#include "hashtable.h"
+
+/*
+* ConcurrentHashTable - a HashTable split into independent shards, each behind
+* its own reader/writer lock. The top bits of a key's hash pick the shard, so
+* threads working on different shards never wait for each other; Get and
+* IfExists take the shard lock shared, so readers of one shard run together,
+* and Insert, TryEmplace and Remove take it exclusively. Every shard resizes
+* on its own, so a resize stalls only the callers that hash into that shard. A key is hashed once per call: the same
+* hash picks the shard and, shifted, is handed to the shard's table.
+*
+* Values are shared_ptr and Get returns a copy, so a value stays valid after
+* the lock is released even if another thread removes it.
+*/
+template <class keyT, class dataT, class Hash = DefaultHash<keyT>, class KeyEqual = std::equal_to<keyT>>
+class ConcurrentHashTable {
+    private:
+        static const int LINE = 64;
+        static const int SHARD_BITS = 16;
+
+        //The shard's own buckets come from the hash bits below the ones that picked the shard;
+        //the table only calls this itself when it rehashes.
+        struct ShardHash {
+            uint64_t operator()(const keyT& key) const {
+                return Hash()(key) << SHARD_BITS;
+            }
+        };
+
+        typedef HashTable<keyT, dataT, SharedValuePolicy, ShardHash, KeyEqual> Table;
+
+        struct alignas(LINE) Shard {
+            mutable std::shared_mutex lock;
+            Table table;
+        };
+
+        int shardCount;
+        Shard* shards;
+
+        Shard& ShardFor(uint64_t hash) const;
+        void CopyFrom(const ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>& source);
+
+    public:
+        static const int DEFAULT_SHARDS = 64;
+        static const int MAX_SHARDS = 1 << SHARD_BITS;
+
+        explicit ConcurrentHashTable(int shards = DEFAULT_SHARDS);
+        ConcurrentHashTable(const ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>& copy) = delete;
+        ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>& operator=(const ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>& copy) = delete;
+        ~ConcurrentHashTable();
+
+        //Adds key if it is absent; returns whether it was added.
+        bool Insert(const keyT& key, const std::shared_ptr<dataT>& data);
+        template <class... Args>
+        std::pair<std::shared_ptr<dataT>, bool> TryEmplace(const keyT& key, Args&&... args);
+        void Remove(const keyT& key);
+        std::shared_ptr<dataT> Get(const keyT& key) const;
+        bool IfExists(const keyT& key) const;
+        //Sums the shards one at a time, so it is exact only when no writer is running.
+        int Size() const;
+        int Shards() const {
+            return shardCount;
+        }
+        void Reserve(int count);
+        static std::shared_ptr<ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>> Merge(const ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>& ht1, const ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>& ht2);
+};
+
+template <class keyT, class dataT, class Hash, class KeyEqual>
+ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>::ConcurrentHashTable(int shards) : shardCount(shards), shards(nullptr) {
+    if (shardCount < 1)
+        shardCount = 1;
+    if (shardCount > MAX_SHARDS)
+        shardCount = MAX_SHARDS;
+    this->shards = new Shard[shardCount];
+}
+
+template <class keyT, class dataT, class Hash, class KeyEqual>
+ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>::~ConcurrentHashTable() {
+    delete [] shards;
+}
+
+//Same multiply and shift as HashTable::Bucket, so the shard count does not have to be a power of two.
+template <class keyT, class dataT, class Hash, class KeyEqual>
+typename ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>::Shard& ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>::ShardFor(uint64_t hash) const {
+    return shards[(hash >> 32) * (uint64_t)shardCount >> 32];
+}
+
+template <class keyT, class dataT, class Hash, class KeyEqual>
+bool ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>::Insert(const keyT& key, const std::shared_ptr<dataT>& data) {
+    uint64_t hash = Hash()(key);
+    Shard& shard = ShardFor(hash);
+    std::unique_lock<std::shared_mutex> guard(shard.lock);
+    return shard.table.InsertHashed(key, hash << SHARD_BITS, data);
+}
+
+//Builds the value only if key is absent; returns the value stored under key.
+template <class keyT, class dataT, class Hash, class KeyEqual>
+template <class... Args>
+std::pair<std::shared_ptr<dataT>, bool> ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>::TryEmplace(const keyT& key, Args&&... args) {
+    uint64_t hash = Hash()(key);
+    Shard& shard = ShardFor(hash);
+    std::unique_lock<std::shared_mutex> guard(shard.lock);
+    return shard.table.TryEmplaceHashed(key, hash << SHARD_BITS, std::forward<Args>(args)...);
+}
+
+template <class keyT, class dataT, class Hash, class KeyEqual>
+void ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>::Remove(const keyT& key) {
+    uint64_t hash = Hash()(key);
+    Shard& shard = ShardFor(hash);
+    std::unique_lock<std::shared_mutex> guard(shard.lock);
+    shard.table.RemoveHashed(key, hash << SHARD_BITS);
+}
+
+template <class keyT, class dataT, class Hash, class KeyEqual>
+std::shared_ptr<dataT> ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>::Get(const keyT& key) const {
+    uint64_t hash = Hash()(key);
+    Shard& shard = ShardFor(hash);
+    std::shared_lock<std::shared_mutex> guard(shard.lock);
+    return shard.table.GetHashed(key, hash << SHARD_BITS);
+}
+
+template <class keyT, class dataT, class Hash, class KeyEqual>
+bool ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>::IfExists(const keyT& key) const {
+    uint64_t hash = Hash()(key);
+    Shard& shard = ShardFor(hash);
+    std::shared_lock<std::shared_mutex> guard(shard.lock);
+    return shard.table.IfExistsHashed(key, hash << SHARD_BITS);
+}
+
+template <class keyT, class dataT, class Hash, class KeyEqual>
+int ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>::Size() const {
+    int size = 0;
+    for (int i = 0; i < shardCount; i++) {
+        std::shared_lock<std::shared_mutex> guard(shards[i].lock);
+        size +=  shards[i].table.size;
+    }
+    return size;
+}
+
+//Gives every shard room for its share of count entries, locking one shard at a time.
+template <class keyT, class dataT, class Hash, class KeyEqual>
+void ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>::Reserve(int count) {
+    int perShard = count / shardCount + 1;
+    for (int i = 0; i < shardCount; i++) {
+        std::unique_lock<std::shared_mutex> guard(shards[i].lock);
+        shards[i].table.Reserve(perShard);
+    }
+}
+
+/*
+* Adds the entries of source that this table lacks. Each source shard is read
+* under its shared lock, so writers on source only wait for the shard being
+* copied. This table is not locked; it must not be visible to other threads.
+*/
+template <class keyT, class dataT, class Hash, class KeyEqual>
+void ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>::CopyFrom(const ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>& source) {
+    for (int i = 0; i < source.shardCount; i++) {
+        std::shared_lock<std::shared_mutex> guard(source.shards[i].lock);
+        source.shards[i].table.ForEach([this](const typename Table::Node& node) {
+            uint64_t hash = Hash()(node.key);
+            ShardFor(hash).table.InsertHashed(node.key, hash << SHARD_BITS, node.data);
+        });
+    }
+}
+
+//Safe to call while other threads use ht1 and ht2; entries they change mid-merge may or may not be included.
+template <class keyT, class dataT, class Hash, class KeyEqual>
+std::shared_ptr<ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>> ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>::Merge(const ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>& ht1, const ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>& ht2) {
+    std::shared_ptr<ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>> merged = std::shared_ptr<ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>>(new ConcurrentHashTable<keyT, dataT, Hash, KeyEqual>(ht1.shardCount > ht2.shardCount ? ht1.shardCount : ht2.shardCount));
+    merged->CopyFrom(ht1);
+    merged->CopyFrom(ht2);
+    return merged;
+}
+
+#endif /* CONCURRENT_HASH_TABLE_H_ */
@@ -0,0 +1,372 @@
+#ifndef FLAT_HASH_TABLE_H_
+#define FLAT_HASH_TABLE_H_
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <utility>
+#include "hash.h"
+#include "valueStorage.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+* FlatHashTable - an open addressing table with the same API as HashTable.
+* Entries live in one flat array, with a parallel array of one control byte per
+* slot: EMPTY, or the low 7 bits of the entry's hash. A lookup compares 16
+* control bytes at once (one SSE2 compare), and only touches an entry when its
+* control byte matches, so most lookups read one control line and one entry.
+*
+* Probing is linear at slot granularity and removal shifts the rest of the
+* cluster back, so the table never holds tombstones and never has to be
+* rebuilt to get rid of them. The first GROUP control bytes are mirrored past
+* the end so a 16 byte window can start at any slot. A new or moved-from table
+* has no arrays at all (capacity 0); the first insert allocates them.
+*/
+template <class keyT, class dataT, class ValuePolicy = SharedValuePolicy, class Hash = DefaultHash<keyT>,
+          class KeyEqual = std::equal_to<keyT>>
+class FlatHashTable {
+    public:
+        typedef typename ValuePolicy::template Stored<dataT> StoredT;
+        typedef typename ValuePolicy::template Handle<dataT> HandleT;
+
+    private:
+        struct Slot {
+            keyT key;
+            StoredT data;
+        };
+
+        static const int GROUP = 16;
+        static const int8_t EMPTY = -128;
+
+        int capacity;
+        int8_t* ctrl;
+        Slot* slots;
+
+        static uint64_t HashOf(const keyT& key) {
+            return Hash()(key);
+        }
+        static int Home(uint64_t hash, int capacity) {
+            return (int)(hash >> 7) & (capacity - 1);
+        }
+        static int8_t Tag(uint64_t hash) {
+            return (int8_t)(hash & 0x7f);
+        }
+        static uint32_t MatchTag(const int8_t* group, int8_t tag);
+        static uint32_t MatchEmpty(const int8_t* group);
+        static int LowestBit(uint32_t mask);
+        static int CapacityFor(int count);
+        int FindSlot(const keyT& key, uint64_t hash, int* empty) const;
+        int FindEmpty(int home) const;
+        void SetCtrl(int i, int8_t value);
+        void Rehash(int newCapacity);
+        void Release();
+        template <class Value>
+        int InsertValue(const keyT& key, uint64_t hash, int empty, Value&& data);
+
+    public:
+        int size;
+
+        FlatHashTable();
+        FlatHashTable(const FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>& copy);
+        FlatHashTable(FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>&& other) noexcept;
+        FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>& operator=(const FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>& copy);
+        FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>& operator=(FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>&& other) noexcept;
+        ~FlatHashTable();
+        void Insert(const keyT& key, StoredT& data);
+        void Insert(const keyT& key, StoredT&& data);
+        template <class... Args>
+        std::pair<HandleT, bool> TryEmplace(const keyT& key, Args&&... args);
+        void Remove(const keyT& key);
+        HandleT Get(const keyT& key) const;
+        bool IfExists(const keyT& key) const;
+        static std::shared_ptr<FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>> Merge(const FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>& ht1, const FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>& ht2);
+};
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual>
+uint32_t FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>::MatchTag(const int8_t* group, int8_t tag) {
+#if defined(__SSE2__)
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(tag)));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < GROUP; i++)
+        mask |= (uint32_t)(group[i] == tag) << i;
+    return mask;
+#endif
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual>
+uint32_t FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>::MatchEmpty(const int8_t* group) {
+#if defined(__SSE2__)
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(group)));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < GROUP; i++)
+        mask |= (uint32_t)(group[i] == EMPTY) << i;
+    return mask;
+#endif
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual>
+int FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>::LowestBit(uint32_t mask) {
+#if defined(__GNUC__)
+    return __builtin_ctz(mask);
+#else
+    int bit = 0;
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+//The smallest power of two, at least GROUP, that keeps count entries under a 7/8 load.
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual>
+int FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>::CapacityFor(int count) {
+    int newCapacity = GROUP;
+    while ((long)newCapacity * 7 / 8 < count)
+        newCapacity *= 2;
+    return newCapacity;
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual>
+FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>::FlatHashTable() : capacity(0), ctrl(nullptr), slots(nullptr), size(0) {}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual>
+FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>::FlatHashTable(const FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>& copy) :
+    capacity(0), ctrl(nullptr), slots(nullptr), size(0) {
+    if (copy.capacity == 0)
+        return;
+    this->Rehash(copy.capacity);
+    for (int i = 0; i < copy.capacity; i++)
+        if (copy.ctrl[i] != EMPTY)
+            new (slots + i) Slot{copy.slots[i].key, copy.slots[i].data};
+    std::memcpy(ctrl, copy.ctrl, capacity + GROUP);
+    size = copy.size;
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual>
+FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>::FlatHashTable(FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>&& other) noexcept :
+    capacity(other.capacity), ctrl(other.ctrl), slots(other.slots), size(other.size) {
+    other.capacity = 0;
+    other.ctrl = nullptr;
+    other.slots = nullptr;
+    other.size = 0;
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual>
+FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>& FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>::operator=(const FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>& copy) {
+    if (this != &copy) {
+        FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual> temp(copy);
+        *this = std::move(temp);
+    }
+    return *this;
+}
+
+//Swaps the arrays, so other is left as a valid table holding our old entries until it is destroyed.
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual>
+FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>& FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>::operator=(FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>&& other) noexcept {
+    std::swap(capacity, other.capacity);
+    std::swap(ctrl, other.ctrl);
+    std::swap(slots, other.slots);
+    std::swap(size, other.size);
+    return *this;
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual>
+FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>::~FlatHashTable() {
+    this->Release();
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual>
+void FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>::Release() {
+    if (ctrl == nullptr)
+        return;
+    for (int i = 0; i < capacity; i++)
+        if (ctrl[i] != EMPTY)
+            slots[i].~Slot();
+    ::operator delete(slots);
+    delete [] ctrl;
+    ctrl = nullptr;
+    slots = nullptr;
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual>
+void FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>::SetCtrl(int i, int8_t value) {
+    ctrl[i] = value;
+    if (i < GROUP)
+        ctrl[capacity + i] = value;
+}
+
+//Returns key's slot, or -1 and (when empty is given) the slot an insert of key should take.
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual>
+int FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>::FindSlot(const keyT& key, uint64_t hash, int* empty) const {
+    if (capacity == 0) {
+        if (empty != nullptr)
+            *empty = -1;
+        return -1;
+    }
+    int8_t tag = Tag(hash);
+    int pos = Home(hash, capacity);
+    while (true) {
+        const int8_t* group = ctrl + pos;
+        for (uint32_t match = MatchTag(group, tag); match != 0; match &= match - 1) {
+            int i = (pos + LowestBit(match)) & (capacity - 1);
+            if (KeyEqual()(slots[i].key, key))
+                return i;
+        }
+        uint32_t free = MatchEmpty(group);
+        if (free != 0) {
+            if (empty != nullptr)
+                *empty = (pos + LowestBit(free)) & (capacity - 1);
+            return -1;
+        }
+        pos = (pos + GROUP) & (capacity - 1);
+    }
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual>
+int FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>::FindEmpty(int home) const {
+    int pos = home;
+    while (true) {
+        uint32_t empty = MatchEmpty(ctrl + pos);
+        if (empty != 0)
+            return (pos + LowestBit(empty)) & (capacity - 1);
+        pos = (pos + GROUP) & (capacity - 1);
+    }
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual>
+void FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>::Rehash(int newCapacity) {
+    int oldCapacity = capacity;
+    int8_t* oldCtrl = ctrl;
+    Slot* oldSlots = slots;
+
+    slots = static_cast<Slot*>(::operator new(sizeof(Slot) * newCapacity));
+    ctrl = new int8_t[newCapacity + GROUP];
+    std::memset(ctrl, EMPTY, newCapacity + GROUP);
+    capacity = newCapacity;
+
+    for (int i = 0; i < oldCapacity; i++) {
+        if (oldCtrl[i] == EMPTY)
+            continue;
+        uint64_t hash = HashOf(oldSlots[i].key);
+        int j = this->FindEmpty(Home(hash, capacity));
+        new (slots + j) Slot{std::move(oldSlots[i].key), std::move(oldSlots[i].data)};
+        this->SetCtrl(j, Tag(hash));
+        oldSlots[i].~Slot();
+    }
+    ::operator delete(oldSlots);
+    delete [] oldCtrl;
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual>
+typename FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>::HandleT FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>::Get(const keyT& key) const {
+    int i = this->FindSlot(key, HashOf(key), nullptr);
+    if (i < 0)
+        return nullptr;
+    return ValuePolicy::Ref(slots[i].data);
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual>
+bool FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>::IfExists(const keyT& key) const {
+    return this->FindSlot(key, HashOf(key), nullptr) >= 0;
+}
+
+//Adds an absent key at empty, the slot FindSlot gave for it (or -1 to look one up); returns the slot used.
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual>
+template <class Value>
+int FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>::InsertValue(const keyT& key, uint64_t hash, int empty, Value&& data) {
+    if ((long)(size + 1) * 8 > (long)capacity * 7) {
+        this->Rehash(capacity == 0 ? GROUP : capacity * 2);
+        empty = -1;
+    }
+    if (empty < 0)
+        empty = this->FindEmpty(Home(hash, capacity));
+    new (slots + empty) Slot{key, std::forward<Value>(data)};
+    this->SetCtrl(empty, Tag(hash));
+    size++;
+    return empty;
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual>
+void FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>::Insert(const keyT& key, StoredT& data) {
+    uint64_t hash = HashOf(key);
+    int empty;
+    if (this->FindSlot(key, hash, &empty) < 0)
+        this->InsertValue(key, hash, empty, static_cast<const StoredT&>(data));
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual>
+void FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>::Insert(const keyT& key, StoredT&& data) {
+    uint64_t hash = HashOf(key);
+    int empty;
+    if (this->FindSlot(key, hash, &empty) < 0)
+        this->InsertValue(key, hash, empty, std::move(data));
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual>
+template <class... Args>
+std::pair<typename FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>::HandleT, bool> FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>::TryEmplace(const keyT& key, Args&&... args) {
+    uint64_t hash = HashOf(key);
+    int empty;
+    int i = this->FindSlot(key, hash, &empty);
+    if (i >= 0)
+        return std::make_pair(ValuePolicy::Ref(slots[i].data), false);
+
+    i = this->InsertValue(key, hash, empty, ValuePolicy::template Make<dataT>(std::forward<Args>(args)...));
+    return std::make_pair(ValuePolicy::Ref(slots[i].data), true);
+}
+
+/*
+* Backward shift deletion: walk the rest of the cluster and pull back every
+* entry whose home slot is at or before the hole, so no entry is ever separated
+* from its home by an empty slot.
+*/
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual>
+void FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>::Remove(const keyT& key) {
+    int hole = this->FindSlot(key, HashOf(key), nullptr);
+    if (hole < 0)
+        return;
+
+    int mask = capacity - 1;
+    slots[hole].~Slot();
+    for (int j = (hole + 1) & mask; ctrl[j] != EMPTY; j = (j + 1) & mask) {
+        int home = Home(HashOf(slots[j].key), capacity);
+        if (((j - home) & mask) < ((j - hole) & mask))
+            continue;
+        new (slots + hole) Slot{std::move(slots[j].key), std::move(slots[j].data)};
+        slots[j].~Slot();
+        this->SetCtrl(hole, ctrl[j]);
+        hole = j;
+    }
+    this->SetCtrl(hole, EMPTY);
+    size--;
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual>
+std::shared_ptr<FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>> FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>::Merge(const FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>& ht1, const FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>& ht2) {
+    std::shared_ptr<FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>> merged = std::make_shared<FlatHashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual>>();
+    merged->Rehash(CapacityFor(ht1.size + ht2.size));
+    for (int i = 0; i < ht1.capacity; i++)
+        if (ht1.ctrl[i] != EMPTY)
+            merged->InsertValue(ht1.slots[i].key, HashOf(ht1.slots[i].key), -1, ht1.slots[i].data);
+
+    for (int i = 0; i < ht2.capacity; i++) {
+        if (ht2.ctrl[i] == EMPTY)
+            continue;
+        uint64_t hash = HashOf(ht2.slots[i].key);
+        int empty;
+        if (merged->FindSlot(ht2.slots[i].key, hash, &empty) < 0)
+            merged->InsertValue(ht2.slots[i].key, hash, empty, ht2.slots[i].data);
+    }
+    return merged;
+}
+
+#endif /* FLAT_HASH_TABLE_H_ */
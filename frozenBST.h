@@ -0,0 +1,293 @@
+#ifndef FROZEN_BST_H_
+#define FROZEN_BST_H_
+
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include "compare.h"
+#include "valueStorage.h"
+
+/*
+* FrozenBST - an immutable snapshot of a BST laid out in Eytzinger (BFS) order.
+* keys[1] is the root and the children of keys[k] are keys[2k] and keys[2k + 1],
+* so a search reads one contiguous array top down. The descent has no
+* data dependent branch (k = 2k + (keys[k] orders before key)), and for arithmetic keys
+* it prefetches the cache line holding the descendants a few levels further down.
+*/
+template <class keyT, class dataT, class ValuePolicy = SharedValuePolicy, class Compare = DefaultCompare>
+class FrozenBST {
+    private:
+        static const int LINE = 64;
+        static const int PREFETCH_STRIDE = std::is_arithmetic<keyT>::value && sizeof(keyT) <= 16 ? LINE / sizeof(keyT) : 0;
+
+        typedef typename ValuePolicy::template Stored<dataT> StoredT;
+        typedef typename ValuePolicy::template Handle<dataT> HandleT;
+
+        int n;
+        keyT* keys;
+        StoredT* data;
+
+        template <class Iterator>
+        void Fill(Iterator& it, int k);
+        int LowerBound(const keyT& key) const;
+        int UpperBound(const keyT& key) const;
+        static int Climb(int k);
+        void Prefetch(int k) const;
+        void Release();
+
+    public:
+        class const_iterator;
+
+        //Builds from size entries in increasing key order; *begin must expose key and data.
+        template <class Iterator>
+        FrozenBST(Iterator begin, int size);
+        FrozenBST() : n(0), keys(nullptr), data(nullptr) {}
+        FrozenBST(const FrozenBST<keyT, dataT, ValuePolicy, Compare>& copy) = delete;
+        FrozenBST<keyT, dataT, ValuePolicy, Compare>& operator=(const FrozenBST<keyT, dataT, ValuePolicy, Compare>& copy) = delete;
+        FrozenBST(FrozenBST<keyT, dataT, ValuePolicy, Compare>&& other);
+        FrozenBST<keyT, dataT, ValuePolicy, Compare>& operator=(FrozenBST<keyT, dataT, ValuePolicy, Compare>&& other);
+        ~FrozenBST();
+
+        int Size() const {
+            return n;
+        }
+        HandleT Get(const keyT& target) const;
+        bool Find(const keyT& target) const;
+        const_iterator begin() const;
+        const_iterator end() const;
+        const_iterator lower_bound(const keyT& key) const;
+        const_iterator upper_bound(const keyT& key) const;
+};
+
+template <class keyT, class dataT, class ValuePolicy, class Compare>
+class FrozenBST<keyT, dataT, ValuePolicy, Compare>::const_iterator {
+    private:
+        const FrozenBST<keyT, dataT, ValuePolicy, Compare>* tree;
+        int k;
+
+        const_iterator(const FrozenBST<keyT, dataT, ValuePolicy, Compare>* tree, int k) : tree(tree), k(k) {}
+        friend class FrozenBST<keyT, dataT, ValuePolicy, Compare>;
+
+    public:
+        struct Entry {
+            const keyT& key;
+            const StoredT& data;
+
+            const Entry* operator->() const { return this; }
+        };
+
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef Entry value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef Entry pointer;
+        typedef Entry reference;
+
+        Entry operator*() const { return Entry{tree->keys[k], tree->data[k]}; }
+        Entry operator->() const { return **this; }
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+        bool operator==(const const_iterator& iterator) const { return k == iterator.k; }
+        bool operator!=(const const_iterator& iterator) const { return k != iterator.k; }
+};
+
+template <class keyT, class dataT, class ValuePolicy, class Compare>
+template <class Iterator>
+FrozenBST<keyT, dataT, ValuePolicy, Compare>::FrozenBST(Iterator begin, int size) : n(size), keys(nullptr), data(nullptr) {
+    keys = static_cast<keyT*>(::operator new(sizeof(keyT) * (n + 1), std::align_val_t(LINE)));
+    data = new StoredT[n + 1];
+    int k = 0;
+    try {
+        for (; k <= n; k++)
+            new (keys + k) keyT();
+        Fill(begin, 1);
+    }
+    catch (...) {
+        while (k > 0)
+            keys[--k].~keyT();
+        ::operator delete(keys, std::align_val_t(LINE));
+        delete[] data;
+        throw;
+    }
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Compare>
+FrozenBST<keyT, dataT, ValuePolicy, Compare>::FrozenBST(FrozenBST<keyT, dataT, ValuePolicy, Compare>&& other) : n(other.n), keys(other.keys), data(other.data) {
+    other.n = 0;
+    other.keys = nullptr;
+    other.data = nullptr;
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Compare>
+FrozenBST<keyT, dataT, ValuePolicy, Compare>& FrozenBST<keyT, dataT, ValuePolicy, Compare>::operator=(FrozenBST<keyT, dataT, ValuePolicy, Compare>&& other) {
+    if (this != &other) {
+        Release();
+        n = other.n;
+        keys = other.keys;
+        data = other.data;
+        other.n = 0;
+        other.keys = nullptr;
+        other.data = nullptr;
+    }
+    return *this;
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Compare>
+FrozenBST<keyT, dataT, ValuePolicy, Compare>::~FrozenBST() {
+    Release();
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Compare>
+void FrozenBST<keyT, dataT, ValuePolicy, Compare>::Release() {
+    if (keys == nullptr)
+        return;
+    for (int k = 0; k <= n; k++)
+        keys[k].~keyT();
+    ::operator delete(keys, std::align_val_t(LINE));
+    delete[] data;
+    keys = nullptr;
+    data = nullptr;
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Compare>
+template <class Iterator>
+void FrozenBST<keyT, dataT, ValuePolicy, Compare>::Fill(Iterator& it, int k) {
+    if (k > n)
+        return;
+    Fill(it, 2 * k);
+    keys[k] = it->key;
+    data[k] = it->data;
+    ++it;
+    Fill(it, 2 * k + 1);
+}
+
+//Undoes the trailing right turns of a descent: the answer is the last node we went left at.
+template <class keyT, class dataT, class ValuePolicy, class Compare>
+int FrozenBST<keyT, dataT, ValuePolicy, Compare>::Climb(int k) {
+#if defined(__GNUC__)
+    return k >> (__builtin_ctz(~k) + 1);
+#else
+    while (k & 1)
+        k >>= 1;
+    return k >> 1;
+#endif
+}
+
+//Fetches the line holding the descendants of k a few levels down, while they are still inside keys.
+template <class keyT, class dataT, class ValuePolicy, class Compare>
+void FrozenBST<keyT, dataT, ValuePolicy, Compare>::Prefetch(int k) const {
+#if defined(__GNUC__)
+    if (PREFETCH_STRIDE > 0 && (long)k * PREFETCH_STRIDE <= n)
+        __builtin_prefetch(keys + (long)k * PREFETCH_STRIDE);
+#else
+    (void)k;
+#endif
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Compare>
+int FrozenBST<keyT, dataT, ValuePolicy, Compare>::LowerBound(const keyT& key) const {
+    int k = 1;
+    while (k <= n) {
+        Prefetch(k);
+        k = 2 * k + (Compare::Order(keys[k], key) < 0);
+    }
+    return Climb(k);
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Compare>
+int FrozenBST<keyT, dataT, ValuePolicy, Compare>::UpperBound(const keyT& key) const {
+    int k = 1;
+    while (k <= n) {
+        Prefetch(k);
+        k = 2 * k + (Compare::Order(keys[k], key) <= 0);
+    }
+    return Climb(k);
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Compare>
+typename FrozenBST<keyT, dataT, ValuePolicy, Compare>::HandleT FrozenBST<keyT, dataT, ValuePolicy, Compare>::Get(const keyT& target) const {
+    int k = LowerBound(target);
+    if (k == 0 || Compare::Order(keys[k], target) != 0)
+        return nullptr;
+    return ValuePolicy::Ref(data[k]);
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Compare>
+bool FrozenBST<keyT, dataT, ValuePolicy, Compare>::Find(const keyT& target) const {
+    int k = LowerBound(target);
+    return k != 0 && Compare::Order(keys[k], target) == 0;
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Compare>
+typename FrozenBST<keyT, dataT, ValuePolicy, Compare>::const_iterator FrozenBST<keyT, dataT, ValuePolicy, Compare>::begin() const {
+    int k = 1;
+    while (2 * k <= n)
+        k = 2 * k;
+    return const_iterator(this, n == 0 ? 0 : k);
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Compare>
+typename FrozenBST<keyT, dataT, ValuePolicy, Compare>::const_iterator FrozenBST<keyT, dataT, ValuePolicy, Compare>::end() const {
+    return const_iterator(this, 0);
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Compare>
+typename FrozenBST<keyT, dataT, ValuePolicy, Compare>::const_iterator FrozenBST<keyT, dataT, ValuePolicy, Compare>::lower_bound(const keyT& key) const {
+    return const_iterator(this, LowerBound(key));
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Compare>
+typename FrozenBST<keyT, dataT, ValuePolicy, Compare>::const_iterator FrozenBST<keyT, dataT, ValuePolicy, Compare>::upper_bound(const keyT& key) const {
+    return const_iterator(this, UpperBound(key));
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Compare>
+typename FrozenBST<keyT, dataT, ValuePolicy, Compare>::const_iterator& FrozenBST<keyT, dataT, ValuePolicy, Compare>::const_iterator::operator++() {
+    if (2 * k + 1 <= tree->n) {
+        k = 2 * k + 1;
+        while (2 * k <= tree->n)
+            k = 2 * k;
+    }
+    else
+        k = Climb(k);
+    return *this;
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Compare>
+typename FrozenBST<keyT, dataT, ValuePolicy, Compare>::const_iterator FrozenBST<keyT, dataT, ValuePolicy, Compare>::const_iterator::operator++(int) {
+    const_iterator result = *this;
+    ++*this;
+    return result;
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Compare>
+typename FrozenBST<keyT, dataT, ValuePolicy, Compare>::const_iterator& FrozenBST<keyT, dataT, ValuePolicy, Compare>::const_iterator::operator--() {
+    if (k == 0) {
+        k = tree->n == 0 ? 0 : 1;
+        while (k != 0 && 2 * k + 1 <= tree->n)
+            k = 2 * k + 1;
+        return *this;
+    }
+    if (2 * k <= tree->n) {
+        k = 2 * k;
+        while (2 * k + 1 <= tree->n)
+            k = 2 * k + 1;
+    }
+    else {
+        while (k != 0 && (k & 1) == 0)
+            k >>= 1;
+        k >>= 1;
+    }
+    return *this;
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Compare>
+typename FrozenBST<keyT, dataT, ValuePolicy, Compare>::const_iterator FrozenBST<keyT, dataT, ValuePolicy, Compare>::const_iterator::operator--(int) {
+    const_iterator result = *this;
+    --*this;
+    return result;
+}
+
+#endif /* FROZEN_BST_H_ */
@@ -0,0 +1,132 @@
+#ifndef HASH_H_
+#define HASH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+/*
+* Hash functions for HashTable and FlatHashTable. A Hash is a function object
+* returning a 64 bit value; the tables take bucket indexes and tags straight
+* from its high and low bits, so every output bit has to depend on every
+* input bit. DefaultHash<T> does that for integers, enums, pointers, strings,
+* std::pair and std::tuple, and passes anything else through std::hash
+* followed by MixHash.
+*/
+
+//The murmur3 64 bit finalizer.
+inline uint64_t MixHash(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+//Full 64x64 -> 128 bit multiply, folded back to 64 bits.
+inline uint64_t MultiplyFold(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+    __uint128_t product = (__uint128_t)a * b;
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+#else
+    return MixHash(a ^ MixHash(b));
+#endif
+}
+
+/*
+* Hashes a byte string 16 bytes per step, two 8 byte words folded by one wide
+* multiply, in the style of wyhash. The tail is read with a short memcpy so the
+* loads never go past the end of the buffer.
+*/
+inline uint64_t HashBytes(const void* data, size_t len, uint64_t seed = 0) {
+    const uint64_t K0 = 0xa0761d6478bd642fULL;
+    const uint64_t K1 = 0xe7037ed1a0b428dbULL;
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t h = seed ^ MultiplyFold(len ^ K0, K1);
+
+    for (; len >= 16; len -= 16, bytes += 16) {
+        uint64_t a, b;
+        std::memcpy(&a, bytes, 8);
+        std::memcpy(&b, bytes + 8, 8);
+        h = MultiplyFold(a ^ K0 ^ h, b ^ K1);
+    }
+    uint64_t a = 0, b = 0;
+    if (len > 8) {
+        std::memcpy(&a, bytes, 8);
+        std::memcpy(&b, bytes + 8, len - 8);
+    }
+    else
+        std::memcpy(&a, bytes, len);
+    return MultiplyFold(a ^ K0 ^ h, b ^ K1);
+}
+
+inline uint64_t HashCombine(uint64_t seed, uint64_t h) {
+    return MultiplyFold(seed ^ 0xa0761d6478bd642fULL, h ^ 0xe7037ed1a0b428dbULL);
+}
+
+template <class T, class Enable = void>
+struct DefaultHash {
+    uint64_t operator()(const T& key) const {
+        return MixHash(std::hash<T>()(key));
+    }
+};
+
+template <class T>
+struct DefaultHash<T, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type> {
+    uint64_t operator()(T key) const {
+        return MixHash((uint64_t)key);
+    }
+};
+
+template <class T>
+struct DefaultHash<T*> {
+    uint64_t operator()(T* key) const {
+        return MixHash((uint64_t)(uintptr_t)key);
+    }
+};
+
+template <class Char, class Traits>
+struct DefaultHash<std::basic_string_view<Char, Traits>> {
+    uint64_t operator()(std::basic_string_view<Char, Traits> key) const {
+        return HashBytes(key.data(), key.size() * sizeof(Char));
+    }
+};
+
+template <class Char, class Traits, class Alloc>
+struct DefaultHash<std::basic_string<Char, Traits, Alloc>> {
+    uint64_t operator()(const std::basic_string<Char, Traits, Alloc>& key) const {
+        return HashBytes(key.data(), key.size() * sizeof(Char));
+    }
+};
+
+template <class A, class B>
+struct DefaultHash<std::pair<A, B>> {
+    uint64_t operator()(const std::pair<A, B>& key) const {
+        return HashCombine(DefaultHash<A>()(key.first), DefaultHash<B>()(key.second));
+    }
+};
+
+template <class... T>
+struct DefaultHash<std::tuple<T...>> {
+    uint64_t operator()(const std::tuple<T...>& key) const {
+        return Combine(key, std::index_sequence_for<T...>());
+    }
+
+    private:
+        template <size_t... I>
+        static uint64_t Combine(const std::tuple<T...>& key, std::index_sequence<I...>) {
+            uint64_t h = sizeof...(T);
+            using expand = int[];
+            (void)expand{0, (h = HashCombine(h, DefaultHash<typename std::tuple_element<I, std::tuple<T...>>::type>()(std::get<I>(key))), 0)...};
+            return h;
+        }
+};
+
+#endif /* HASH_H_ */
@@ -2,187 +2,950 @@
 #define HASH_TABLE_H_
 
 
+#include <cstdint>
+#include <functional>
+#include <iterator>
 #include <memory>
-#include "listNode.h"
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
 #include <stdbool.h>
+#include <type_traits>
+#include "filter.h"
+#include "hash.h"
+#include "mappedHashTable.h"
+#include "nodeAllocator.h"
+#include "taskPool.h"
+#include "valueStorage.h"
 
 
-template <class keyT, class dataT>
+/*
+* Load factor policies for HashTable. The table grows by GROWTH times once
+* size reaches MAX_LOAD * m and shrinks by GROWTH times once size drops below
+* MIN_LOAD * m. A resize lands at load MAX_LOAD / GROWTH or MIN_LOAD * GROWTH,
+* strictly between the two limits, so the table never bounces between sizes.
+*/
+struct DefaultLoadPolicy {
+    static constexpr double MAX_LOAD = 1.0;
+    static constexpr double MIN_LOAD = 1.0 / 9;
+    static constexpr int GROWTH = 3;
+};
+
+/*
+* HashTable - separate chaining, resized by LoadPolicy.
+* In the default BLOCKING_RESIZE mode a resize moves every node before the
+* call returns. In INCREMENTAL_RESIZE mode a resize only allocates the new
+* bucket array, uninitialized. Every later Insert and Remove initializes the
+* next REHASH_STEP * BUILD_RATIO of its buckets while the table keeps using
+* the old array, and once it is complete moves the next REHASH_STEP old
+* buckets over. Until the old array is drained, lookups check the new array
+* and then the old one, and arr holds only part of the entries.
+* Chain nodes come from NodePolicy: one shared_ptr allocation each by default,
+* or carved out of the table's own slabs with SlabNodePolicy.
+* EnableFilter puts a BlockedBloomFilter in front of the buckets, so most
+* lookups of absent keys end after one word of the filter instead of a chain walk.
+*/
+template <class keyT, class dataT, class ValuePolicy = SharedValuePolicy, class Hash = DefaultHash<keyT>,
+          class KeyEqual = std::equal_to<keyT>, class LoadPolicy = DefaultLoadPolicy, class NodePolicy = SharedNodePolicy>
 class HashTable {
+    public:
+        typedef typename ValuePolicy::template Stored<dataT> StoredT;
+        typedef typename ValuePolicy::template Handle<dataT> HandleT;
+
+        struct Node;
+        typedef typename NodePolicy::template Link<Node> Link;
+
+        struct Node {
+            keyT key;
+            StoredT data;
+            Link next;
+
+            Node(const keyT& key, const StoredT& data) : key(key), data(data), next(nullptr) {}
+            Node(const keyT& key, StoredT&& data) : key(key), data(std::move(data)), next(nullptr) {}
+        };
+
+        enum ResizeMode { BLOCKING_RESIZE, INCREMENTAL_RESIZE };
+
     private:
-        void ChangeSize(bool expand);
+        static const int REHASH_STEP = 4;
+        static const int BUILD_RATIO = 64;
+        static const int MIN_BUCKETS = 3;
+        static const int MULTI_BATCH = 16;
+        static const int PARALLEL_GRAIN = 1 << 12;
+        static const int MIN_FILTER = 1 << 10;
+        static_assert(LoadPolicy::GROWTH > 1 && LoadPolicy::MIN_LOAD * LoadPolicy::GROWTH < LoadPolicy::MAX_LOAD,
+                      "LoadPolicy limits must leave room for hysteresis");
+
+        typedef typename NodePolicy::template Pool<Node> Pool;
+
+        Link* oldArr;
+        int oldM;
+        int rehashIndex;
+        Link* nextArr;      //the array a resize is still initializing, built of its nextM links are ready
+        int nextM;
+        int built;
+        ResizeMode mode;
+        int minM;
+        Pool pool;
+        std::unique_ptr<BlockedBloomFilter> filter;
+
+        static int BucketOf(uint64_t hash, int m);
+        static int Bucket(const keyT& key, int m);
+        bool RemoveFrom(Link& head, const keyT& key);
+        void CloneFrom(const HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>& copy);
+        void DropChains(Link* buckets, int from, int to);
+        void Swap(HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>& other);
+        int CopyRange(const HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>& source, int from, int to, Pool& nodes, bool unique);
+        void CopyParts(const HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>& ht1, const HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>& ht2, int first, int last, int parts,
+                       Pool* pools, int* added, TaskPool* tasks);
+        template <class Function>
+        void DrainNodes(Function fn);
+        Node* FindNode(const keyT& key, uint64_t hash) const;
+        Node* Lookup(const keyT& key, uint64_t hash) const;
+        Node* FindOld(const keyT& key, uint64_t hash) const;
+        void RebuildFilter(int bitsPerKey);
+        template <class Visit>
+        void MultiFind(const keyT* keys, int count, Visit visit) const;
+        static void Prefetch(const void* address);
+        int Slots() const;
+        const Link& Slot(int i) const;
+        template <class Function>
+        void ForEachIn(int from, int to, Function& fn, TaskPool* tasks) const;
+        static int BucketsFor(int count);
+        static Link* NewBuckets(int count);
+        static void FreeBuckets(Link* buckets, int count);
+        void Resize(int newM, bool drain);
+        void RehashStep(int buckets);
+        void FinishResize();
+        template <class Value>
+        Node* InsertValue(const keyT& key, uint64_t hash, Value&& data);
 
     public:
+        class const_iterator;
+
         int m;
         int size;
-        std::shared_ptr<ListNode<keyT, dataT>>* arr;
+        Link* arr;
 
         HashTable();
-        HashTable(const HashTable<keyT, dataT>& copy);
-        HashTable<keyT, dataT>& operator=(const HashTable<keyT, dataT>& copy);
+        explicit HashTable(ResizeMode mode);
+        explicit HashTable(int capacity, ResizeMode mode = BLOCKING_RESIZE);
+        HashTable(const HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>& copy);
+        HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>& operator=(const HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>& copy);
         ~HashTable();
-        void Insert(keyT key, std::shared_ptr<dataT>& data);
-        void Remove(keyT key);
-        std::shared_ptr<dataT> Get(keyT key) const;
-        bool IfExists(keyT key) const;
-        static std::shared_ptr<HashTable<keyT, dataT>> Merge(const HashTable<keyT, dataT>& ht1, const HashTable<keyT, dataT>& ht2);
+        void Insert(const keyT& key, StoredT& data);
+        void Insert(const keyT& key, StoredT&& data);
+        template <class... Args>
+        std::pair<HandleT, bool> TryEmplace(const keyT& key, Args&&... args);
+        void Remove(const keyT& key);
+        HandleT Get(const keyT& key) const;
+        bool IfExists(const keyT& key) const;
+        //The same operations for a caller that already has hash == Hash()(key); the Insert ones return whether key was added.
+        bool InsertHashed(const keyT& key, uint64_t hash, const StoredT& data);
+        bool InsertHashed(const keyT& key, uint64_t hash, StoredT&& data);
+        template <class... Args>
+        std::pair<HandleT, bool> TryEmplaceHashed(const keyT& key, uint64_t hash, Args&&... args);
+        void RemoveHashed(const keyT& key, uint64_t hash);
+        HandleT GetHashed(const keyT& key, uint64_t hash) const;
+        bool IfExistsHashed(const keyT& key, uint64_t hash) const;
+        void MultiGet(const keyT* keys, int count, HandleT* out) const;
+        void MultiContains(const keyT* keys, int count, bool* out) const;
+        const_iterator begin() const;
+        const_iterator end() const;
+        template <class Function>
+        void ForEach(Function fn) const;
+        template <class Function>
+        void ParallelForEach(Function fn, TaskPool* tasks) const;
+        void Save(const char* path) const;
+        void EnableFilter(int bitsPerKey = 8);
+        void DisableFilter();
+        //The filter in front of lookups, or nullptr; reports its size and false positive rate.
+        const BlockedBloomFilter* Filter() const {
+            return filter.get();
+        }
+        static MappedHashTable<keyT, dataT, Hash, KeyEqual> OpenMapped(const char* path);
+        void Reserve(int count);
+        void ShrinkToFit();
+        static std::shared_ptr<HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>> Merge(const HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>& ht1, const HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>& ht2,
+                                                                                                  TaskPool* tasks = nullptr);
+        static std::shared_ptr<HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>> Merge(HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>&& ht1, HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>&& ht2);
+};
+
+/*
+* const_iterator visits every entry once, in bucket order. It holds a raw
+* pointer to the current node, so stepping costs no reference count updates.
+* Any insertion or removal invalidates it.
+*/
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+class HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::const_iterator {
+    private:
+        const HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>* table;
+        int slot;
+        const Node* node;
+
+        const_iterator(const HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>* table, int slot) : table(table), slot(slot), node(nullptr) {}
+        friend class HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>;
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef Node value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const Node* pointer;
+        typedef const Node& reference;
+
+        const Node& operator*() const { return *node; }
+        const Node* operator->() const { return node; }
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        bool operator==(const const_iterator& iterator) const { return node == iterator.node && slot == iterator.slot; }
+        bool operator!=(const const_iterator& iterator) const { return !(*this == iterator); }
 };
 
-template <class keyT, class dataT>
-HashTable<keyT, dataT>::HashTable() : m(3), size(0) {
-    arr = new std::shared_ptr<ListNode<keyT, dataT>>[m];
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+typename HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::const_iterator& HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::const_iterator::operator++() {
+    if (node != nullptr)
+        node = Pool::Raw(node->next);
+    int slots = table->Slots();
+    while (node == nullptr && ++slot < slots)
+        node = Pool::Raw(table->Slot(slot));
+    return *this;
 }
 
-template <class keyT, class dataT>
-HashTable<keyT, dataT>::HashTable(const HashTable<keyT, dataT>& copy) : m(copy.m), size(copy.size) {
-    arr = new std::shared_ptr<ListNode<keyT, dataT>>[m];
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+typename HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::const_iterator HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::const_iterator::operator++(int) {
+    const_iterator result = *this;
+    ++*this;
+    return result;
+}
+
+/*
+* Maps the top 32 bits of the hash onto [0, m) with one multiply and a shift
+* instead of a division, so m does not have to be a power of two.
+*/
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+int HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::BucketOf(uint64_t hash, int m) {
+    return (int)((hash >> 32) * (uint64_t)m >> 32);
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+int HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::Bucket(const keyT& key, int m) {
+    return BucketOf(Hash()(key), m);
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::HashTable() : oldArr(nullptr), oldM(0), rehashIndex(0), nextArr(nullptr), nextM(0), built(0), mode(BLOCKING_RESIZE), minM(MIN_BUCKETS), m(MIN_BUCKETS), size(0) {
+    arr = NewBuckets(m);
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::HashTable(ResizeMode mode) : oldArr(nullptr), oldM(0), rehashIndex(0), nextArr(nullptr), nextM(0), built(0), mode(mode), minM(MIN_BUCKETS), m(MIN_BUCKETS), size(0) {
+    arr = NewBuckets(m);
+}
+
+//Allocates once for capacity entries; the table will not shrink below that until ShrinkToFit.
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::HashTable(int capacity, ResizeMode mode) :
+    oldArr(nullptr), oldM(0), rehashIndex(0), nextArr(nullptr), nextM(0), built(0), mode(mode), minM(BucketsFor(capacity)), m(minM), size(0) {
+    arr = NewBuckets(m);
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::HashTable(const HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>& copy) :
+    oldArr(nullptr), oldM(0), rehashIndex(0), nextArr(nullptr), nextM(0), built(0), mode(copy.mode), minM(copy.minM),
+    filter(copy.filter != nullptr ? new BlockedBloomFilter(*copy.filter) : nullptr), m(copy.m), size(copy.size) {
+    arr = NewBuckets(m);
+    this->CloneFrom(copy);
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>& HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::operator=(const HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>& copy) {
+    if (this != &copy) {
+        HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy> clone(copy);
+        this->Swap(clone);
+    }
+    return *this;
+}
+
+/*
+* Fills the empty arr, which has copy.m buckets, with copies of copy's entries.
+* Chains are cloned bucket by bucket in order, so nothing is rehashed, and with
+* SlabNodePolicy all the nodes go into one slab sized up front.
+*/
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::CloneFrom(const HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>& copy) {
+    pool.Reserve(copy.size);
     for (int i = 0; i < m; i++) {
-        std::shared_ptr<ListNode<keyT, dataT>> curr = copy.arr[i];
-        while (curr) {
-            std::shared_ptr<ListNode<keyT, dataT>> toAdd = std::shared_ptr<ListNode<keyT, dataT>>(new ListNode<keyT, dataT>(curr->key, curr->data));
-            std::shared_ptr<ListNode<keyT, dataT>> head = arr[curr->key % m];
-            toAdd->next = head;
-            arr[curr->key % m] = std::make_shared<ListNode<keyT, dataT>>(*toAdd);
-            curr = curr->next;
+        Link* tail = arr + i;
+        for (Node* curr = Pool::Raw(copy.arr[i]); curr != nullptr; curr = Pool::Raw(curr->next)) {
+            *tail = pool.Create(curr->key, curr->data);
+            tail = &(*tail)->next;
         }
     }
+    if (copy.oldArr == nullptr)
+        return;
+    for (int i = copy.rehashIndex; i < copy.oldM; i++)
+        for (Node* curr = Pool::Raw(copy.oldArr[i]); curr != nullptr; curr = Pool::Raw(curr->next)) {
+            int bucket = Bucket(curr->key, m);
+            Link toAdd = pool.Create(curr->key, curr->data);
+            toAdd->next = std::move(arr[bucket]);
+            arr[bucket] = std::move(toAdd);
+        }
 }
 
-template <class keyT, class dataT>
-HashTable<keyT, dataT>& HashTable<keyT, dataT>::operator=(const HashTable<keyT, dataT>& copy) {
-    std::shared_ptr<ListNode<keyT, dataT>>* newArr = new std::shared_ptr<ListNode<keyT, dataT>>[copy.m];
-    for (int i = 0; i < copy.m; i++) {
-        std::shared_ptr<ListNode<keyT, dataT>> curr = copy.arr[i];
-        while (curr) {
-            std::shared_ptr<ListNode<keyT, dataT>> toAdd = std::shared_ptr<ListNode<keyT, dataT>>(new ListNode<keyT, dataT>(curr->key, curr->data));
-            std::shared_ptr<ListNode<keyT, dataT>> head = newArr[curr->key % copy.m];
-            toAdd->next = head;
-            newArr[curr->key % copy.m] = std::make_shared<ListNode<keyT, dataT>>(*toAdd);
-            curr = curr->next;
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::Swap(HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>& other) {
+    std::swap(oldArr, other.oldArr);
+    std::swap(oldM, other.oldM);
+    std::swap(rehashIndex, other.rehashIndex);
+    std::swap(nextArr, other.nextArr);
+    std::swap(nextM, other.nextM);
+    std::swap(built, other.built);
+    std::swap(mode, other.mode);
+    std::swap(minM, other.minM);
+    std::swap(pool, other.pool);
+    std::swap(filter, other.filter);
+    std::swap(m, other.m);
+    std::swap(size, other.size);
+    std::swap(arr, other.arr);
+}
+
+//Releases the nodes chained from buckets[from, to) one by one, without recursing down a chain.
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::DropChains(Link* buckets, int from, int to) {
+    if (buckets == nullptr || std::is_trivially_destructible<Node>::value)
+        return;
+    for (int i = from; i < to; i++) {
+        Link curr = std::move(buckets[i]);
+        while (curr != nullptr) {
+            Link next = std::move(curr->next);
+            pool.Release(curr);
+            curr = std::move(next);
         }
     }
+}
 
-    delete [] arr;
-    this->arr = newArr;
-    this->m = copy.m;
-    this->size = copy.size;
-
-    return *this;
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::~HashTable() {
+    this->DropChains(arr, 0, m);
+    this->DropChains(oldArr, rehashIndex, oldM);
+    FreeBuckets(arr, m);
+    FreeBuckets(oldArr, oldM);
+    FreeBuckets(nextArr, built);
 }
 
-template <class keyT, class dataT>
-HashTable<keyT, dataT>::~HashTable() {
-    delete [] arr;
+/*
+* The buckets an iteration walks: arr[0, m) followed by the old buckets an
+* incremental resize has not moved yet, so every entry is visited once.
+*/
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+int HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::Slots() const {
+    return oldArr == nullptr ? m : m + oldM - rehashIndex;
 }
 
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+const typename HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::Link& HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::Slot(int i) const {
+    return i < m ? arr[i] : oldArr[rehashIndex + i - m];
+}
 
-template <class keyT, class dataT>
-std::shared_ptr<dataT> HashTable<keyT, dataT>::Get(keyT key) const {
-    std::shared_ptr<ListNode<keyT, dataT>> curr = arr[key % m];
-    while (curr != nullptr) {
-        if (curr->key == key)
-            return curr->data;
-        curr = curr->next;
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+template <class Function>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::ForEachIn(int from, int to, Function& fn, TaskPool* tasks) const {
+    if (tasks != nullptr && to - from > PARALLEL_GRAIN) {
+        int middle = from + (to - from) / 2;
+        tasks->Invoke([&] { this->ForEachIn(from, middle, fn, tasks); },
+                      [&] { this->ForEachIn(middle, to, fn, tasks); });
+        return;
     }
+    for (int i = from; i < to; i++)
+        for (const Node* curr = Pool::Raw(Slot(i)); curr != nullptr; curr = Pool::Raw(curr->next))
+            fn(*curr);
+}
 
+//Calls fn(node) for every entry, in bucket order.
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+template <class Function>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::ForEach(Function fn) const {
+    this->ForEachIn(0, this->Slots(), fn, nullptr);
+}
+
+//Splits the buckets into ranges that run on the workers of tasks; fn must be safe to call concurrently.
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+template <class Function>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::ParallelForEach(Function fn, TaskPool* tasks) const {
+    this->ForEachIn(0, this->Slots(), fn, tasks);
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+typename HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::const_iterator HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::begin() const {
+    const_iterator result(this, -1);
+    return ++result;
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+typename HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::const_iterator HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::end() const {
+    return const_iterator(this, this->Slots());
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+typename HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::Node* HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::FindNode(const keyT& key, uint64_t hash) const {
+    for (Node* curr = Pool::Raw(arr[BucketOf(hash, m)]); curr != nullptr; curr = Pool::Raw(curr->next))
+        if (KeyEqual()(curr->key, key))
+            return curr;
+    return this->FindOld(key, hash);
+}
+
+//Looks key up among the entries an incremental resize has not moved yet.
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+typename HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::Node* HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::FindOld(const keyT& key, uint64_t hash) const {
+    if (oldArr == nullptr)
+        return nullptr;
+    int bucket = BucketOf(hash, oldM);
+    if (bucket < rehashIndex)
+        return nullptr;
+    for (Node* curr = Pool::Raw(oldArr[bucket]); curr != nullptr; curr = Pool::Raw(curr->next))
+        if (KeyEqual()(curr->key, key))
+            return curr;
     return nullptr;
 }
 
-template <class keyT, class dataT>
-bool HashTable<keyT, dataT>::IfExists(keyT key) const {
-    if (this->Get(key) != nullptr)
-        return true;
-    return false;
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::Prefetch(const void* address) {
+#if defined(__GNUC__)
+    __builtin_prefetch(address);
+#else
+    (void)address;
+#endif
 }
 
-template <class keyT, class dataT>
-void HashTable<keyT, dataT>::Insert(keyT key, std::shared_ptr<dataT>& data) {
-    if (this->IfExists(key))
-        return;
-    
-    std::shared_ptr<ListNode<keyT, dataT>> toAdd = std::shared_ptr<ListNode<keyT, dataT>>(new ListNode<keyT, dataT>(key, data));
-    std::shared_ptr<ListNode<keyT, dataT>> head = arr[key % m];
-    toAdd->next = head;
-    arr[key % m] = std::make_shared<ListNode<keyT, dataT>>(*toAdd);
-    size++;
+/*
+* Looks up MULTI_BATCH keys at a time in stages, so their cache misses overlap
+* instead of following one another: hash every key, drop the ones the filter
+* rules out and prefetch the bucket of the rest,
+* then load every bucket head and prefetch the node, then walk the chains in
+* rounds that compare one node per unresolved key and prefetch its successor.
+* Calls visit(i, node) for every keys[i], with node == nullptr on a miss.
+*/
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+template <class Visit>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::MultiFind(const keyT* keys, int count, Visit visit) const {
+    uint64_t hashes[MULTI_BATCH];
+    int buckets[MULTI_BATCH];
+    Node* nodes[MULTI_BATCH];
+    int pending[MULTI_BATCH];
+
+    for (int base = 0; base < count; base += MULTI_BATCH) {
+        int batch = count - base < MULTI_BATCH ? count - base : MULTI_BATCH;
+        for (int i = 0; i < batch; i++) {
+            hashes[i] = Hash()(keys[base + i]);
+            buckets[i] = filter != nullptr && !filter->MayContain(hashes[i]) ? -1 : BucketOf(hashes[i], m);
+            if (buckets[i] >= 0)
+                Prefetch(arr + buckets[i]);
+        }
+        int lookups = 0;
+        for (int i = 0; i < batch; i++) {
+            if (buckets[i] < 0) {
+                visit(base + i, nullptr);
+                continue;
+            }
+            nodes[i] = Pool::Raw(arr[buckets[i]]);
+            Prefetch(nodes[i]);
+            pending[lookups++] = i;
+        }
+        batch = lookups;
 
-    if (size == m)
-        this->ChangeSize(true);
-    
+        while (batch > 0) {
+            int left = 0;
+            for (int j = 0; j < batch; j++) {
+                int i = pending[j];
+                Node* curr = nodes[i];
+                if (curr == nullptr)
+                    visit(base + i, this->FindOld(keys[base + i], hashes[i]));
+                else if (KeyEqual()(curr->key, keys[base + i]))
+                    visit(base + i, curr);
+                else {
+                    nodes[i] = Pool::Raw(curr->next);
+                    Prefetch(nodes[i]);
+                    pending[left++] = i;
+                }
+            }
+            batch = left;
+        }
+    }
 }
 
-template <class keyT, class dataT>
-void HashTable<keyT, dataT>::Remove(keyT key) {
-    if (!this->IfExists(key))
-        return;
+//out[i] is the value stored under keys[i], or nullptr.
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::MultiGet(const keyT* keys, int count, HandleT* out) const {
+    this->MultiFind(keys, count, [out](int i, Node* node) {
+        out[i] = node == nullptr ? nullptr : ValuePolicy::Ref(node->data);
+    });
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::MultiContains(const keyT* keys, int count, bool* out) const {
+    this->MultiFind(keys, count, [out](int i, Node* node) {
+        out[i] = node != nullptr;
+    });
+}
+
+//FindNode behind the filter.
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+typename HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::Node* HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::Lookup(const keyT& key, uint64_t hash) const {
+    if (filter != nullptr && !filter->MayContain(hash))
+        return nullptr;
+    return this->FindNode(key, hash);
+}
 
-    std::shared_ptr<ListNode<keyT, dataT>> curr = arr[key % m];
-    if (curr->key == key) {
-            arr[key % m] = curr->next;
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+typename HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::HandleT HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::Get(const keyT& key) const {
+    return this->GetHashed(key, Hash()(key));
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+typename HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::HandleT HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::GetHashed(const keyT& key, uint64_t hash) const {
+    Node* node = this->Lookup(key, hash);
+    if (node == nullptr)
+        return nullptr;
+    return ValuePolicy::Ref(node->data);
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+bool HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::IfExists(const keyT& key) const {
+    return this->Lookup(key, Hash()(key)) != nullptr;
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+bool HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::IfExistsHashed(const keyT& key, uint64_t hash) const {
+    return this->Lookup(key, hash) != nullptr;
+}
+
+//Links a new node for key, which the caller knows is absent, and returns it; a resize moves links, never nodes.
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+template <class Value>
+typename HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::Node* HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::InsertValue(const keyT& key, uint64_t hash, Value&& data) {
+    this->RehashStep(REHASH_STEP);
+    Link toAdd = pool.Create(key, std::forward<Value>(data));
+    Node* node = Pool::Raw(toAdd);
+    int bucket = BucketOf(hash, m);
+    toAdd->next = std::move(arr[bucket]);
+    arr[bucket] = std::move(toAdd);
+    size++;
+
+    if (filter != nullptr) {
+        filter->Add(hash);
+        if (filter->Added() > filter->Capacity())
+            this->RebuildFilter(filter->BitsPerKey());
     }
-    else {
-        while (curr != nullptr && curr->next != nullptr) {
-            if (curr->next->key == key) {
-                curr->next = curr->next->next;
-                break;
-            }
-            curr = curr->next;
+
+    if (nextArr == nullptr && size >= LoadPolicy::MAX_LOAD * m)
+        this->Resize(m * LoadPolicy::GROWTH, mode == BLOCKING_RESIZE);
+    return node;
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::Insert(const keyT& key, StoredT& data) {
+    this->InsertHashed(key, Hash()(key), static_cast<const StoredT&>(data));
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::Insert(const keyT& key, StoredT&& data) {
+    this->InsertHashed(key, Hash()(key), std::move(data));
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+bool HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::InsertHashed(const keyT& key, uint64_t hash, const StoredT& data) {
+    if (this->Lookup(key, hash) != nullptr)
+        return false;
+    this->InsertValue(key, hash, data);
+    return true;
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+bool HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::InsertHashed(const keyT& key, uint64_t hash, StoredT&& data) {
+    if (this->Lookup(key, hash) != nullptr)
+        return false;
+    this->InsertValue(key, hash, std::move(data));
+    return true;
+}
+
+//Builds the value only if key is absent; returns a handle to the value stored under key.
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+template <class... Args>
+std::pair<typename HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::HandleT, bool> HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::TryEmplace(const keyT& key, Args&&... args) {
+    return this->TryEmplaceHashed(key, Hash()(key), std::forward<Args>(args)...);
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+template <class... Args>
+std::pair<typename HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::HandleT, bool> HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::TryEmplaceHashed(const keyT& key, uint64_t hash, Args&&... args) {
+    Node* node = this->Lookup(key, hash);
+    if (node != nullptr)
+        return std::make_pair(ValuePolicy::Ref(node->data), false);
+
+    node = this->InsertValue(key, hash, ValuePolicy::template Make<dataT>(std::forward<Args>(args)...));
+    return std::make_pair(ValuePolicy::Ref(node->data), true);
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+bool HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::RemoveFrom(Link& head, const keyT& key) {
+    for (Link* link = &head; *link != nullptr; link = &(*link)->next) {
+        if (KeyEqual()((*link)->key, key)) {
+            Link removed = std::move(*link);
+            *link = std::move(removed->next);
+            pool.Release(removed);
+            return true;
         }
     }
+    return false;
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::Remove(const keyT& key) {
+    this->RemoveHashed(key, Hash()(key));
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::RemoveHashed(const keyT& key, uint64_t hash) {
+    this->RehashStep(REHASH_STEP);
+    bool removed = this->RemoveFrom(arr[BucketOf(hash, m)], key);
+    if (!removed && oldArr != nullptr) {
+        int bucket = BucketOf(hash, oldM);
+        if (bucket >= rehashIndex)
+            removed = this->RemoveFrom(oldArr[bucket], key);
+    }
+    if (!removed)
+        return;
+
     size--;
-    if (((double)size / m) <= 1/9 && size != 0)
-        this->ChangeSize(false);
+    if (filter != nullptr) {
+        filter->Erase();
+        if (filter->Erased() > size)
+            this->RebuildFilter(filter->BitsPerKey());
+    }
+    if (nextArr == nullptr && m > minM && size < LoadPolicy::MIN_LOAD * m)
+        this->Resize(m / LoadPolicy::GROWTH > minM ? m / LoadPolicy::GROWTH : minM, mode == BLOCKING_RESIZE);
 }
 
-template <class keyT, class dataT>
-void HashTable<keyT, dataT>::ChangeSize(bool expand) {
-    int newM = m;
-    std::shared_ptr<ListNode<keyT, dataT>>* newArr;
+//The number of buckets that holds count entries below MAX_LOAD.
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+int HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::BucketsFor(int count) {
+    int buckets = (int)(count / LoadPolicy::MAX_LOAD) + 1;
+    return buckets > MIN_BUCKETS ? buckets : MIN_BUCKETS;
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+typename HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::Link* HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::NewBuckets(int count) {
+    Link* buckets = static_cast<Link*>(::operator new(sizeof(Link) * count));
+    for (int i = 0; i < count; i++)
+        new (buckets + i) Link();
+    return buckets;
+}
+
+//Frees an array whose first count links were constructed.
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::FreeBuckets(Link* buckets, int count) {
+    if (buckets == nullptr)
+        return;
+    for (int i = 0; i < count; i++)
+        buckets[i].~Link();
+    ::operator delete(buckets);
+}
+
+//Starts moving the entries into newM buckets; drain finishes the move before returning.
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::Resize(int newM, bool drain) {
+    this->FinishResize();
+
+    nextArr = static_cast<Link*>(::operator new(sizeof(Link) * newM));
+    nextM = newM;
+    built = 0;
+
+    if (drain)
+        this->FinishResize();
+}
 
-    if (expand) {
-        newM = m * 3;
-        newArr = new std::shared_ptr<ListNode<keyT, dataT>>[newM];
-    } else {
-        newM = m / 3;
-        newArr = new std::shared_ptr<ListNode<keyT, dataT>>[newM];
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::FinishResize() {
+    if (nextArr != nullptr)
+        this->RehashStep(nextM);
+    this->RehashStep(oldM);
+}
+
+//Makes room for count entries with one resize; the table will not shrink below that until ShrinkToFit.
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::Reserve(int count) {
+    int buckets = BucketsFor(count);
+    if (buckets > minM)
+        minM = buckets;
+    if (buckets > m)
+        this->Resize(buckets, true);
+}
+
+//Drops any Reserve floor and resizes to the fewest buckets that keep size below MAX_LOAD.
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::ShrinkToFit() {
+    minM = MIN_BUCKETS;
+    int buckets = BucketsFor(size);
+    if (buckets < m)
+        this->Resize(buckets, true);
+    else
+        this->FinishResize();
+}
+
+/*
+* While a new array is being initialized, readies up to buckets * BUILD_RATIO
+* of its links and swaps it in once all are ready. Otherwise moves up to
+* buckets old buckets into arr, and frees the old array once it is drained.
+*/
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::RehashStep(int buckets) {
+    if (nextArr != nullptr) {
+        int stop = (long)buckets * BUILD_RATIO < nextM - built ? built + buckets * BUILD_RATIO : nextM;
+        for (; built < stop; built++)
+            new (nextArr + built) Link();
+        if (built < nextM)
+            return;
+        oldArr = arr;
+        oldM = m;
+        rehashIndex = 0;
+        arr = nextArr;
+        m = nextM;
+        nextArr = nullptr;
+        nextM = 0;
+        built = 0;
     }
+    if (oldArr == nullptr)
+        return;
 
-    for (int i = 0; i < m; i++) {
-        std::shared_ptr<ListNode<keyT, dataT>> curr = this->arr[i];
+    for (; buckets > 0 && rehashIndex < oldM; buckets--, rehashIndex++) {
+        Link curr = std::move(oldArr[rehashIndex]);
         while (curr != nullptr) {
-            std::shared_ptr<ListNode<keyT, dataT>> toAdd = std::shared_ptr<ListNode<keyT, dataT>>(new ListNode<keyT, dataT>(curr->key, curr->data));
-            std::shared_ptr<ListNode<keyT, dataT>> head = newArr[curr->key % newM];
-            toAdd->next = head;
-            newArr[curr->key % newM] = std::make_shared<ListNode<keyT, dataT>>(*toAdd);
-            curr = curr->next;
+            Link next = std::move(curr->next);
+            int bucket = Bucket(curr->key, m);
+            curr->next = std::move(arr[bucket]);
+            arr[bucket] = std::move(curr);
+            curr = std::move(next);
         }
     }
-    this->m = newM;
 
-    delete [] this->arr;
-    this->arr = newArr;
+    if (rehashIndex == oldM) {
+        FreeBuckets(oldArr, oldM);
+        oldArr = nullptr;
+        oldM = 0;
+        rehashIndex = 0;
+    }
 }
 
-template <class keyT, class dataT>
-std::shared_ptr<HashTable<keyT, dataT>> HashTable<keyT, dataT>::Merge(const HashTable<keyT, dataT>& ht1, const HashTable<keyT, dataT>& ht2) {
-    std::shared_ptr<HashTable<keyT, dataT>> merged = std::shared_ptr<HashTable<keyT, dataT>>(new HashTable<keyT, dataT>());
-    for (int i = 0; i < ht1.m; i++) {
-        std::shared_ptr<ListNode<keyT, dataT>> curr = ht1.arr[i];
-        while (curr) {
-            merged->Insert(curr->key, curr->data);
-            curr = curr->next;
+/*
+* Copies the entries of source that land in buckets [from, to) of this table,
+* creating the nodes in nodes. Bucket is monotonic in the hash, so only the
+* source buckets covering the same hash range are read. With unique set the
+* caller knows no key is in this table yet and the duplicate check is skipped.
+* Returns the number of entries added.
+*/
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+int HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::CopyRange(const HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>& source, int from, int to, Pool& nodes, bool unique) {
+    int added = 0;
+    auto copyChain = [&](const Link& head) {
+        for (Node* curr = Pool::Raw(head); curr != nullptr; curr = Pool::Raw(curr->next)) {
+            int bucket = Bucket(curr->key, m);
+            if (bucket < from || bucket >= to)
+                continue;
+            if (!unique) {
+                Node* existing = Pool::Raw(arr[bucket]);
+                while (existing != nullptr && !KeyEqual()(existing->key, curr->key))
+                    existing = Pool::Raw(existing->next);
+                if (existing != nullptr)
+                    continue;
+            }
+            Link toAdd = nodes.Create(curr->key, curr->data);
+            toAdd->next = std::move(arr[bucket]);
+            arr[bucket] = std::move(toAdd);
+            added++;
         }
+    };
+
+    int first = (int)((int64_t)from * source.m / m);
+    int last = (int)((int64_t)to * source.m / m) + 1;
+    for (int i = first; i < last && i < source.m; i++)
+        copyChain(source.arr[i]);
+    if (source.oldArr != nullptr) {
+        first = (int)((int64_t)from * source.oldM / m);
+        last = (int)((int64_t)to * source.oldM / m) + 1;
+        for (int i = first > source.rehashIndex ? first : source.rehashIndex; i < last && i < source.oldM; i++)
+            copyChain(source.oldArr[i]);
     }
+    return added;
+}
 
-    for (int i = 0; i < ht2.m; i++) {
-        std::shared_ptr<ListNode<keyT, dataT>> curr = ht2.arr[i];
-        while (curr) {
-            merged->Insert(curr->key, curr->data);
-            curr = curr->next;
-        }
+//Fills parts [first, last) of the bucket array, each on its own node pool.
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::CopyParts(const HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>& ht1, const HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>& ht2, int first, int last, int parts,
+                                                                              Pool* pools, int* added, TaskPool* tasks) {
+    if (last - first > 1) {
+        int middle = first + (last - first) / 2;
+        tasks->Invoke([&] { this->CopyParts(ht1, ht2, first, middle, parts, pools, added, tasks); },
+                      [&] { this->CopyParts(ht1, ht2, middle, last, parts, pools, added, tasks); });
+        return;
+    }
+    int from = (int)((int64_t)m * first / parts);
+    int to = (int)((int64_t)m * (first + 1) / parts);
+    added[first] = this->CopyRange(ht1, from, to, pools[first], true) + this->CopyRange(ht2, from, to, pools[first], false);
+}
+
+/*
+* The result is sized for both inputs up front, so it never resizes while it
+* fills, and the entries of ht1 go in without a lookup. Keys in both keep the
+* value from ht1. With tasks the bucket array is cut into ranges that workers
+* fill independently, since no two ranges share a bucket.
+*/
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+std::shared_ptr<HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>> HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::Merge(const HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>& ht1, const HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>& ht2,
+                                                                                                 TaskPool* tasks) {
+    std::shared_ptr<HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>> merged = std::shared_ptr<HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>>(new HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>(ht1.size + ht2.size));
+    merged->minM = MIN_BUCKETS;
+    const BlockedBloomFilter* source = ht1.filter != nullptr ? ht1.filter.get() : ht2.filter.get();
+
+    int parts = tasks == nullptr ? 1 : merged->m / PARALLEL_GRAIN;
+    if (tasks != nullptr && parts > 4 * tasks->Threads())
+        parts = 4 * tasks->Threads();
+    if (parts <= 1) {
+        merged->size = merged->CopyRange(ht1, 0, merged->m, merged->pool, true) + merged->CopyRange(ht2, 0, merged->m, merged->pool, false);
+        if (source != nullptr)
+            merged->RebuildFilter(source->BitsPerKey());
+        return merged;
+    }
+
+    std::vector<Pool> pools(parts);
+    std::vector<int> added(parts, 0);
+    merged->CopyParts(ht1, ht2, 0, parts, parts, pools.data(), added.data(), tasks);
+    for (int i = 0; i < parts; i++) {
+        merged->pool.Absorb(pools[i]);
+        merged->size += added[i];
     }
+    if (source != nullptr)
+        merged->RebuildFilter(source->BitsPerKey());
     return merged;
 }
 
+//Unlinks every node and hands it to fn, leaving the table empty.
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+template <class Function>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::DrainNodes(Function fn) {
+    auto drainChain = [&](Link& head) {
+        Link curr = std::move(head);
+        head = nullptr;
+        while (curr != nullptr) {
+            Link next = std::move(curr->next);
+            curr->next = nullptr;
+            fn(curr);
+            curr = std::move(next);
+        }
+    };
+
+    for (int i = 0; i < m; i++)
+        drainChain(arr[i]);
+    for (int i = rehashIndex; i < oldM; i++)
+        drainChain(oldArr[i]);
+    size = 0;
+    this->FinishResize();
+    if (filter != nullptr)
+        filter->Clear();
+}
+
+/*
+* Takes the nodes of both tables instead of copying them: the result starts
+* as the larger table, grows once for the total, and the nodes of the smaller
+* one are relinked into it. Keys in both keep the value from ht1. Both inputs
+* are left empty.
+*/
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+std::shared_ptr<HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>> HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::Merge(HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>&& ht1, HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>&& ht2) {
+    std::shared_ptr<HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>> merged = std::shared_ptr<HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>>(new HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>());
+    bool firstIsLarger = ht1.size >= ht2.size;
+    HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>& larger = firstIsLarger ? ht1 : ht2;
+    HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>& smaller = firstIsLarger ? ht2 : ht1;
+
+    merged->Swap(larger);
+    merged->pool.Absorb(smaller.pool);
+    int buckets = BucketsFor(merged->size + smaller.size);
+    if (buckets > merged->m)
+        merged->Resize(buckets, true);
+    else
+        merged->FinishResize();
+
+    int bitsPerKey = smaller.filter != nullptr ? smaller.filter->BitsPerKey() : 0;
+    smaller.DrainNodes([&](Link& node) {
+        uint64_t hash = Hash()(node->key);
+        Node* existing = merged->FindNode(node->key, hash);
+        if (existing != nullptr) {
+            if (!firstIsLarger)
+                std::swap(existing->data, node->data);
+            merged->pool.Release(node);
+            return;
+        }
+        int bucket = BucketOf(hash, merged->m);
+        node->next = std::move(merged->arr[bucket]);
+        merged->arr[bucket] = std::move(node);
+        merged->size++;
+        if (merged->filter != nullptr)
+            merged->filter->Add(hash);
+    });
+    if (merged->filter != nullptr ? merged->filter->Added() > merged->filter->Capacity() : bitsPerKey > 0)
+        merged->RebuildFilter(merged->filter != nullptr ? merged->filter->BitsPerKey() : bitsPerKey);
+    return merged;
+}
+
+//Writes the entries in the MappedHashTable format; keyT and dataT must be trivially copyable.
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::Save(const char* path) const {
+    MappedHashTable<keyT, dataT, Hash, KeyEqual>::Write(path, size, [this, path](auto fn) {
+        this->ForEach([&](const Node& node) {
+            if (ValuePolicy::Address(node.data) == nullptr)
+                throw std::runtime_error(std::string("HashTable::Save: ") + path + ": null value");
+            fn(node.key, ValuePolicy::Deref(node.data));
+        });
+    });
+}
+
+//Serves a file written by Save without loading it; throws std::runtime_error if it is not usable.
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+MappedHashTable<keyT, dataT, Hash, KeyEqual> HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::OpenMapped(const char* path) {
+    return MappedHashTable<keyT, dataT, Hash, KeyEqual>(path);
+}
+
+//Replaces the filter with one sized for twice the current entries, filled from them.
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::RebuildFilter(int bitsPerKey) {
+    int capacity = 2 * size > MIN_FILTER ? 2 * size : MIN_FILTER;
+    std::unique_ptr<BlockedBloomFilter> rebuilt(new BlockedBloomFilter(capacity, bitsPerKey));
+    this->ForEach([&](const Node& node) {
+        rebuilt->Add(Hash()(node.key));
+    });
+    filter = std::move(rebuilt);
+}
+
+/*
+* Keeps a blocked Bloom filter of bitsPerKey bits per entry, sized for twice the
+* entries, in front of Get, IfExists, MultiGet and MultiContains. Insert adds to
+* it and it is rebuilt once it has taken as many keys as it was sized for;
+* Remove cannot clear bits, so it is rebuilt once the removed keys it still
+* passes outnumber the entries. 8 bits per key cost 1 to 2 bytes per entry and
+* pass 0.5-3% of absent keys. A key that is present still pays for the
+* filter word: one more random access, which costs the most when the branch
+* on the filter is mispredicted and the bucket load has to wait for it. So
+* the filter pays off only when nearly all lookups miss (see bench/hashFilter).
+*/
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::EnableFilter(int bitsPerKey) {
+    this->RebuildFilter(bitsPerKey);
+}
+
+template <class keyT, class dataT, class ValuePolicy, class Hash, class KeyEqual, class LoadPolicy, class NodePolicy>
+void HashTable<keyT, dataT, ValuePolicy, Hash, KeyEqual, LoadPolicy, NodePolicy>::DisableFilter() {
+    filter = nullptr;
+}
 
 #endif /* HASH_TABLE_H_ */
\ No newline at end of file
@@ -0,0 +1,336 @@
+#ifndef MAPPED_HASH_TABLE_H_
+#define MAPPED_HASH_TABLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "filter.h"
+#include "hash.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAPPED_HASH_TABLE_MMAP 1
+#endif
+
+/*
+* MappedHashTable - a read-only hash table served straight from a file written
+* by HashTable::Save. Opening maps the file (or reads it in one go where mmap is
+* not available) and checks the header and the bucket starts; nothing is
+* rebuilt, and the keys and values are not read.
+*
+* The file holds offsets only, never pointers, so it can be mapped at any
+* address. Entries are grouped by bucket: bucket b owns entries
+* [starts[b], starts[b + 1]), and the keys and the values sit in two separate
+* arrays so a probe reads only keys. Numbers are in the writer's byte order; a
+* file from a machine of the other order fails the version check.
+*
+*     header    MappedHeader, padded to a multiple of LINE
+*     starts    uint32_t[buckets + 1]
+*     keys      keyT[count], aligned to LINE
+*     values    dataT[count], aligned to LINE
+*
+* The header carries a checksum of itself, checked on open, and one of the
+* rest of the file, checked by Verify() since that reads every page. It also
+* holds hashCheck, the hashes of the first few keys folded together: a file
+* opened with a Hash other than the one that wrote it (a different function,
+* or a std::hash from another library) is refused instead of missing keys.
+*
+* Since the contents never change, EnableFilter can build an XorFilter over
+* them: about 1.2 bytes per entry, and most absent keys are answered without
+* touching the starts or the keys.
+*/
+struct MappedHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t keySize;
+    uint32_t dataSize;
+    uint32_t buckets;
+    uint64_t count;
+    uint64_t keysOffset;
+    uint64_t valuesOffset;
+    uint64_t hashCheck;
+    uint64_t bodyChecksum;
+    uint64_t headerChecksum;
+};
+
+template <class keyT, class dataT, class Hash = DefaultHash<keyT>, class KeyEqual = std::equal_to<keyT>>
+class MappedHashTable {
+    private:
+        static const int LINE = 64;
+        static const uint64_t STARTS = (sizeof(MappedHeader) + LINE - 1) / LINE * LINE;
+        static const int HASH_CHECK_KEYS = 16;
+        static const uint32_t VERSION = 2;
+        static_assert(std::is_trivially_copyable<keyT>::value && std::is_trivially_copyable<dataT>::value,
+                      "MappedHashTable stores keys and values as raw bytes");
+        static_assert(alignof(keyT) <= LINE && alignof(dataT) <= LINE,
+                      "MappedHashTable layout assumes LINE alignment");
+
+        const char* base;
+        uint64_t length;
+        bool mapped;
+        const MappedHeader* header;
+        const uint32_t* starts;
+        const keyT* keys;
+        const dataT* values;
+        std::unique_ptr<XorFilter> filter;
+
+        static uint64_t AlignUp(uint64_t offset) {
+            return (offset + LINE - 1) / LINE * LINE;
+        }
+        static int Bucket(uint64_t hash, uint32_t buckets) {
+            return (int)((hash >> 32) * buckets >> 32);
+        }
+        static uint64_t HeaderChecksum(const MappedHeader& header) {
+            return HashBytes(&header, offsetof(MappedHeader, headerChecksum));
+        }
+        static uint64_t HashCheck(const keyT* keys, uint64_t count) {
+            uint64_t check = count;
+            for (uint64_t i = 0; i < count && i < HASH_CHECK_KEYS; i++)
+                check = HashCombine(check, Hash()(keys[i]));
+            return check;
+        }
+        static void Fail(const char* path, const char* what) {
+            throw std::runtime_error(std::string("MappedHashTable: ") + path + ": " + what);
+        }
+        void Load(const char* path);
+        void Release();
+
+    public:
+        explicit MappedHashTable(const char* path);
+        MappedHashTable(const MappedHashTable<keyT, dataT, Hash, KeyEqual>& copy) = delete;
+        MappedHashTable<keyT, dataT, Hash, KeyEqual>& operator=(const MappedHashTable<keyT, dataT, Hash, KeyEqual>& copy) = delete;
+        MappedHashTable(MappedHashTable<keyT, dataT, Hash, KeyEqual>&& other);
+        ~MappedHashTable();
+
+        int Size() const {
+            return header != nullptr ? (int)header->count : 0;
+        }
+        //The value stored under key, or nullptr; valid while this table is open.
+        const dataT* Get(const keyT& key) const;
+        bool IfExists(const keyT& key) const;
+        //Checks the body checksum; reads the whole file.
+        bool Verify() const;
+        //Builds a filter over the keys, in front of Get and IfExists; reads every key once.
+        void EnableFilter();
+        const XorFilter* Filter() const {
+            return filter.get();
+        }
+
+        //Writes count entries; forEach(fn) must call fn(key, value) once for each.
+        template <class ForEach>
+        static void Write(const char* path, int count, ForEach forEach);
+};
+
+template <class keyT, class dataT, class Hash, class KeyEqual>
+MappedHashTable<keyT, dataT, Hash, KeyEqual>::MappedHashTable(const char* path) :
+    base(nullptr), length(0), mapped(false), header(nullptr), starts(nullptr), keys(nullptr), values(nullptr) {
+    this->Load(path);
+    try {
+        if (length < sizeof(MappedHeader))
+            Fail(path, "file too short");
+        header = reinterpret_cast<const MappedHeader*>(base);
+        if (std::memcmp(header->magic, "GDSHASH", 8) != 0)
+            Fail(path, "not a saved HashTable");
+        if (header->version != VERSION)
+            Fail(path, "unsupported version or byte order");
+        if (header->headerChecksum != HeaderChecksum(*header))
+            Fail(path, "header checksum mismatch");
+        if (header->keySize != sizeof(keyT) || header->dataSize != sizeof(dataT))
+            Fail(path, "key or value size does not match");
+        if (header->buckets == 0 || header->count > UINT32_MAX ||
+            header->keysOffset % LINE != 0 || header->valuesOffset % LINE != 0 ||
+            header->keysOffset < STARTS + sizeof(uint32_t) * ((uint64_t)header->buckets + 1) ||
+            header->valuesOffset < header->keysOffset + header->count * sizeof(keyT) ||
+            header->valuesOffset + header->count * sizeof(dataT) != length)
+            Fail(path, "truncated or inconsistent layout");
+        starts = reinterpret_cast<const uint32_t*>(base + STARTS);
+        keys = reinterpret_cast<const keyT*>(base + header->keysOffset);
+        values = reinterpret_cast<const dataT*>(base + header->valuesOffset);
+        //Get trusts starts to stay inside the keys, so they are checked even though the body checksum is not.
+        if (starts[0] != 0 || starts[header->buckets] != header->count)
+            Fail(path, "bucket starts do not match the entry count");
+        for (uint32_t b = 0; b < header->buckets; b++)
+            if (starts[b] > starts[b + 1])
+                Fail(path, "bucket starts out of order");
+        if (header->hashCheck != HashCheck(keys, header->count))
+            Fail(path, "written with a different hash function");
+    }
+    catch (...) {
+        this->Release();
+        throw;
+    }
+}
+
+template <class keyT, class dataT, class Hash, class KeyEqual>
+MappedHashTable<keyT, dataT, Hash, KeyEqual>::MappedHashTable(MappedHashTable<keyT, dataT, Hash, KeyEqual>&& other) :
+    base(other.base), length(other.length), mapped(other.mapped), header(other.header), starts(other.starts), keys(other.keys), values(other.values),
+    filter(std::move(other.filter)) {
+    //The source is left empty: no mapping, no entries.
+    other.base = nullptr;
+    other.length = 0;
+    other.header = nullptr;
+    other.starts = nullptr;
+    other.keys = nullptr;
+    other.values = nullptr;
+}
+
+template <class keyT, class dataT, class Hash, class KeyEqual>
+MappedHashTable<keyT, dataT, Hash, KeyEqual>::~MappedHashTable() {
+    this->Release();
+}
+
+template <class keyT, class dataT, class Hash, class KeyEqual>
+void MappedHashTable<keyT, dataT, Hash, KeyEqual>::Load(const char* path) {
+#if defined(MAPPED_HASH_TABLE_MMAP)
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        Fail(path, "cannot open");
+    struct stat status;
+    if (::fstat(fd, &status) != 0 || status.st_size == 0) {
+        ::close(fd);
+        Fail(path, "cannot read size");
+    }
+    void* address = ::mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (address == MAP_FAILED)
+        Fail(path, "cannot map");
+    base = static_cast<const char*>(address);
+    length = status.st_size;
+    mapped = true;
+#else
+    std::FILE* file = std::fopen(path, "rb");
+    if (file == nullptr)
+        Fail(path, "cannot open");
+    std::fseek(file, 0, SEEK_END);
+    long size = std::ftell(file);
+    std::fseek(file, 0, SEEK_SET);
+    char* buffer = size > 0 ? static_cast<char*>(::operator new(size, std::align_val_t(LINE))) : nullptr;
+    if (buffer == nullptr || std::fread(buffer, 1, size, file) != (size_t)size) {
+        std::fclose(file);
+        ::operator delete(buffer, std::align_val_t(LINE));
+        Fail(path, "cannot read");
+    }
+    std::fclose(file);
+    base = buffer;
+    length = size;
+    mapped = false;
+#endif
+}
+
+template <class keyT, class dataT, class Hash, class KeyEqual>
+void MappedHashTable<keyT, dataT, Hash, KeyEqual>::Release() {
+    if (base == nullptr)
+        return;
+#if defined(MAPPED_HASH_TABLE_MMAP)
+    if (mapped)
+        ::munmap(const_cast<char*>(base), length);
+#endif
+    if (!mapped)
+        ::operator delete(const_cast<char*>(base), std::align_val_t(LINE));
+    base = nullptr;
+    length = 0;
+}
+
+template <class keyT, class dataT, class Hash, class KeyEqual>
+const dataT* MappedHashTable<keyT, dataT, Hash, KeyEqual>::Get(const keyT& key) const {
+    if (header == nullptr)
+        return nullptr;
+    uint64_t hash = Hash()(key);
+    if (filter != nullptr && !filter->MayContain(hash))
+        return nullptr;
+    int bucket = Bucket(hash, header->buckets);
+    for (uint32_t i = starts[bucket]; i < starts[bucket + 1]; i++)
+        if (KeyEqual()(keys[i], key))
+            return values + i;
+    return nullptr;
+}
+
+template <class keyT, class dataT, class Hash, class KeyEqual>
+bool MappedHashTable<keyT, dataT, Hash, KeyEqual>::IfExists(const keyT& key) const {
+    return this->Get(key) != nullptr;
+}
+
+template <class keyT, class dataT, class Hash, class KeyEqual>
+bool MappedHashTable<keyT, dataT, Hash, KeyEqual>::Verify() const {
+    if (header == nullptr)
+        return false;
+    return HashBytes(base + STARTS, length - STARTS) == header->bodyChecksum;
+}
+
+template <class keyT, class dataT, class Hash, class KeyEqual>
+void MappedHashTable<keyT, dataT, Hash, KeyEqual>::EnableFilter() {
+    if (header == nullptr)
+        return;
+    std::vector<uint64_t> hashes(header->count);
+    for (uint64_t i = 0; i < header->count; i++)
+        hashes[i] = Hash()(keys[i]);
+    filter.reset(new XorFilter(hashes.data(), (int)hashes.size()));
+}
+
+/*
+* Buckets by counting: one pass counts the entries of every bucket, a prefix
+* sum turns the counts into starts, and a second pass drops every entry into
+* its slot. The file is assembled in memory and written with one call.
+*/
+template <class keyT, class dataT, class Hash, class KeyEqual>
+template <class ForEach>
+void MappedHashTable<keyT, dataT, Hash, KeyEqual>::Write(const char* path, int count, ForEach forEach) {
+    uint32_t buckets = (uint32_t)count + 1;
+    uint64_t keysOffset = AlignUp(STARTS + sizeof(uint32_t) * ((uint64_t)buckets + 1));
+    uint64_t valuesOffset = AlignUp(keysOffset + (uint64_t)count * sizeof(keyT));
+    uint64_t fileSize = valuesOffset + (uint64_t)count * sizeof(dataT);
+
+    std::vector<char> file(fileSize, 0);
+    uint32_t* starts = reinterpret_cast<uint32_t*>(file.data() + STARTS);
+    keyT* keys = reinterpret_cast<keyT*>(file.data() + keysOffset);
+    dataT* values = reinterpret_cast<dataT*>(file.data() + valuesOffset);
+
+    forEach([&](const keyT& key, const dataT&) {
+        starts[Bucket(Hash()(key), buckets) + 1]++;
+    });
+    for (uint32_t b = 0; b < buckets; b++)
+        starts[b + 1] += starts[b];
+    if (starts[buckets] != (uint32_t)count)
+        Fail(path, "entry count does not match");
+    std::vector<uint32_t> next(starts, starts + buckets);
+    forEach([&](const keyT& key, const dataT& value) {
+        uint32_t slot = next[Bucket(Hash()(key), buckets)]++;
+        std::memcpy(static_cast<void*>(keys + slot), &key, sizeof(keyT));
+        std::memcpy(static_cast<void*>(values + slot), &value, sizeof(dataT));
+    });
+
+    MappedHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "GDSHASH", 8);
+    header.version = VERSION;
+    header.keySize = sizeof(keyT);
+    header.dataSize = sizeof(dataT);
+    header.buckets = buckets;
+    header.count = count;
+    header.keysOffset = keysOffset;
+    header.valuesOffset = valuesOffset;
+    header.hashCheck = HashCheck(keys, count);
+    header.bodyChecksum = HashBytes(file.data() + STARTS, fileSize - STARTS);
+    header.headerChecksum = HeaderChecksum(header);
+    std::memcpy(file.data(), &header, sizeof(header));
+
+    std::FILE* out = std::fopen(path, "wb");
+    if (out == nullptr)
+        Fail(path, "cannot create");
+    bool written = std::fwrite(file.data(), 1, file.size(), out) == file.size();
+    if (std::fclose(out) != 0 || !written)
+        Fail(path, "write failed");
+}
+
+#endif /* MAPPED_HASH_TABLE_H_ */
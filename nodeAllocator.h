@@ -0,0 +1,302 @@
+#ifndef NODE_ALLOCATOR_H_
+#define NODE_ALLOCATOR_H_
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <vector>
+
+/*
+* Node allocation policies for the linked structures (BST nodes, hash chains).
+* A policy exposes the link type nodes use to point at each other and a Pool
+* that creates, releases and copies nodes.
+*
+* SharedNodePolicy - every node is its own std::shared_ptr allocation.
+* SlabNodePolicy   - nodes are carved out of contiguous slabs, linked by raw
+*                    pointers and returned to the system in bulk.
+*/
+struct SharedNodePolicy {
+    template <class T> using Link = std::shared_ptr<T>;
+    template <class T> class Pool;
+};
+
+struct SlabNodePolicy {
+    template <class T> using Link = T*;
+    template <class T> class Pool;
+};
+
+template <class T>
+class SharedNodePolicy::Pool {
+    public:
+        template <class... Args>
+        std::shared_ptr<T> Create(Args&&... args) {
+            return std::make_shared<T>(std::forward<Args>(args)...);
+        }
+
+        void Release(std::shared_ptr<T>& node) {
+            node = nullptr;
+        }
+
+        //Nodes are mutated in place, so a copy must not share them with the original.
+        std::shared_ptr<T> Copy(const std::shared_ptr<T>& root) {
+            return Clone(root);
+        }
+
+        std::shared_ptr<T> Clone(const std::shared_ptr<T>& root);
+
+        void Drop(std::shared_ptr<T>& root) {
+            root = nullptr;
+        }
+
+        void ReleaseTree(std::shared_ptr<T>& root) {
+            root = nullptr;
+        }
+
+        void Clear(std::shared_ptr<T>& root) {
+            root = nullptr;
+        }
+
+        void Absorb(Pool&) {}
+        void Share(const Pool&) {}
+        void Reserve(int) {}
+
+        static T* Raw(const std::shared_ptr<T>& node) {
+            return node.get();
+        }
+};
+
+template <class T>
+std::shared_ptr<T> SharedNodePolicy::Pool<T>::Clone(const std::shared_ptr<T>& root) {
+    if (root == nullptr)
+        return nullptr;
+    std::shared_ptr<T> copy = Create(*root);
+    copy->left = Clone(root->left);
+    copy->right = Clone(root->right);
+    return copy;
+}
+
+/*
+* Slabs are reference counted so that trees cut out of one tree (Split) can keep
+* using the memory they came from. Every node reachable from a tree lives in a
+* slab its pool holds, so destroying the tree and dropping the slabs is enough.
+* Sharing a slab only shares its ownership: a pool carves new nodes only out of
+* its own fill slab, which no other pool ever has, so pools that share slabs
+* can be used from different threads.
+*/
+template <class T>
+class SlabNodePolicy::Pool {
+    private:
+        struct Slab {
+            T* nodes;
+            int capacity;
+            int used;
+
+            explicit Slab(int capacity) :
+                nodes(static_cast<T*>(::operator new(sizeof(T) * capacity))), capacity(capacity), used(0) {}
+            ~Slab() { ::operator delete(nodes); }
+        };
+
+        struct FreeSlot {
+            FreeSlot* next;
+        };
+
+        static const int FIRST_SLAB = 64;
+        static const int MAX_SLAB = 1 << 14;
+
+        std::vector<std::shared_ptr<Slab>> slabs;
+        Slab* fill;             //the slab Create carves from; never shared with another pool
+        FreeSlot* freeList;
+        FreeSlot* freeTail;     //kept so Absorb can splice a whole free list in O(1)
+
+        void AddSlab(int capacity);
+
+    public:
+        Pool() : fill(nullptr), freeList(nullptr), freeTail(nullptr) {}
+        Pool(const Pool& copy) = delete;
+        Pool& operator=(const Pool& copy) = delete;
+        Pool(Pool&& other) : slabs(std::move(other.slabs)), fill(other.fill), freeList(other.freeList), freeTail(other.freeTail) {
+            other.slabs.clear();
+            other.fill = nullptr;
+            other.freeList = nullptr;
+            other.freeTail = nullptr;
+        }
+        Pool& operator=(Pool&& other);
+        ~Pool() = default;
+
+        template <class... Args>
+        T* Create(Args&&... args);
+        void Release(T*& node);
+        T* Copy(const T* root) {
+            return Clone(root);
+        }
+        T* Clone(const T* root);
+        static void Drop(T*& root);
+        void ReleaseTree(T*& root);
+        void Clear(T*& root);
+        void Absorb(Pool& other);
+        void Share(const Pool& other);
+        void Reserve(int n);
+
+        static T* Raw(T* node) {
+            return node;
+        }
+};
+
+template <class T>
+typename SlabNodePolicy::Pool<T>& SlabNodePolicy::Pool<T>::operator=(Pool&& other) {
+    if (this != &other) {
+        slabs = std::move(other.slabs);
+        fill = other.fill;
+        freeList = other.freeList;
+        freeTail = other.freeTail;
+        other.slabs.clear();
+        other.fill = nullptr;
+        other.freeList = nullptr;
+        other.freeTail = nullptr;
+    }
+    return *this;
+}
+
+template <class T>
+void SlabNodePolicy::Pool<T>::AddSlab(int capacity) {
+    slabs.push_back(std::make_shared<Slab>(capacity));
+    fill = slabs.back().get();
+}
+
+//Makes room for n more nodes in a single slab, growing slabs as Create does so small batches do not each get one.
+template <class T>
+void SlabNodePolicy::Pool<T>::Reserve(int n) {
+    if (n <= 0 || (fill != nullptr && fill->capacity - fill->used >= n))
+        return;
+    int capacity = fill == nullptr ? FIRST_SLAB : fill->capacity * 2;
+    if (capacity > MAX_SLAB)
+        capacity = MAX_SLAB;
+    AddSlab(n > capacity ? n : capacity);
+}
+
+template <class T>
+template <class... Args>
+T* SlabNodePolicy::Pool<T>::Create(Args&&... args) {
+    void* place;
+    if (freeList != nullptr) {
+        place = freeList;
+        freeList = freeList->next;
+        if (freeList == nullptr)
+            freeTail = nullptr;
+    }
+    else {
+        if (fill == nullptr || fill->used == fill->capacity) {
+            int capacity = fill == nullptr ? FIRST_SLAB : fill->capacity * 2;
+            AddSlab(capacity > MAX_SLAB ? MAX_SLAB : capacity);
+        }
+        place = fill->nodes + fill->used;
+        fill->used++;
+    }
+    return new (place) T(std::forward<Args>(args)...);
+}
+
+template <class T>
+void SlabNodePolicy::Pool<T>::Release(T*& node) {
+    if (node == nullptr)
+        return;
+    node->~T();
+    FreeSlot* slot = reinterpret_cast<FreeSlot*>(node);
+    slot->next = freeList;
+    freeList = slot;
+    if (freeTail == nullptr)
+        freeTail = slot;
+    node = nullptr;
+}
+
+template <class T>
+T* SlabNodePolicy::Pool<T>::Clone(const T* root) {
+    if (root == nullptr)
+        return nullptr;
+    T* copy = Create(*root);
+    copy->left = Clone(root->left);
+    copy->right = Clone(root->right);
+    return copy;
+}
+
+//Destroys a subtree but leaves its slots to the slabs, so it is safe to call
+//from several threads on disjoint subtrees.
+template <class T>
+void SlabNodePolicy::Pool<T>::Drop(T*& root) {
+    if (!std::is_trivially_destructible<T>::value) {
+        //Destroy the nodes without recursion by rotating left children up.
+        while (root != nullptr) {
+            if (root->left != nullptr) {
+                T* left = root->left;
+                root->left = left->right;
+                left->right = root;
+                root = left;
+            }
+            else {
+                T* right = root->right;
+                root->~T();
+                root = right;
+            }
+        }
+    }
+    root = nullptr;
+}
+
+//Destroys a subtree and puts every slot on the free list, without recursion.
+template <class T>
+void SlabNodePolicy::Pool<T>::ReleaseTree(T*& root) {
+    while (root != nullptr) {
+        if (root->left != nullptr) {
+            T* left = root->left;
+            root->left = left->right;
+            left->right = root;
+            root = left;
+        }
+        else {
+            T* right = root->right;
+            Release(root);
+            root = right;
+        }
+    }
+}
+
+template <class T>
+void SlabNodePolicy::Pool<T>::Clear(T*& root) {
+    Drop(root);
+    slabs.clear();
+    fill = nullptr;
+    freeList = nullptr;
+    freeTail = nullptr;
+}
+
+template <class T>
+void SlabNodePolicy::Pool<T>::Absorb(Pool& other) {
+    if (this == &other)
+        return;
+    Share(other);
+    //other gives its slabs up, so its fill slab stays unshared and this pool can keep filling it.
+    if (fill == nullptr)
+        fill = other.fill;
+    other.fill = nullptr;
+    if (other.freeList != nullptr) {
+        other.freeTail->next = freeList;
+        if (freeList == nullptr)
+            freeTail = other.freeTail;
+        freeList = other.freeList;
+        other.freeList = nullptr;
+        other.freeTail = nullptr;
+    }
+    other.slabs.clear();
+}
+
+template <class T>
+void SlabNodePolicy::Pool<T>::Share(const Pool& other) {
+    if (this == &other || other.slabs.empty())
+        return;
+    slabs.insert(slabs.end(), other.slabs.begin(), other.slabs.end());
+    std::sort(slabs.begin(), slabs.end());
+    slabs.erase(std::unique(slabs.begin(), slabs.end()), slabs.end());
+}
+
+#endif /* NODE_ALLOCATOR_H_ */
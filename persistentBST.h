@@ -0,0 +1,332 @@
+#ifndef PERSISTENT_BST_H_
+#define PERSISTENT_BST_H_
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+/*
+* PersistentBST - an AVL tree whose versions never change once published.
+* Insert and Remove copy the nodes on the search path (and the ones a rotation
+* touches) and publish the new root with an atomic store, so untouched subtrees
+* are shared between versions. Snapshot() is one atomic load; the returned
+* Version keeps its nodes alive and can be queried from any thread with no
+* locking while the writer keeps going. Writers must be serialized by the caller.
+*/
+template <class keyT, class dataT>
+class PersistentBST {
+    private:
+        struct Node;
+        typedef std::shared_ptr<const Node> NodePtr;
+
+        struct Node {
+            keyT key;
+            std::shared_ptr<dataT> data;
+            NodePtr left;
+            NodePtr right;
+            int height;
+            int count;
+
+            Node(const keyT& key, const std::shared_ptr<dataT>& data, NodePtr left, NodePtr right);
+        };
+
+        static const int MAX_DEPTH = 64;
+
+        NodePtr root;
+
+        static int GetHeight(const NodePtr& node) {
+            return node == nullptr ? -1 : node->height;
+        }
+        static int GetCount(const NodePtr& node) {
+            return node == nullptr ? 0 : node->count;
+        }
+        static NodePtr Make(const keyT& key, const std::shared_ptr<dataT>& data, NodePtr left, NodePtr right);
+        static NodePtr Balance(const keyT& key, const std::shared_ptr<dataT>& data, NodePtr left, NodePtr right);
+        static NodePtr InsertAux(const NodePtr& node, const keyT& key, const std::shared_ptr<dataT>& data, bool assign, bool* changed);
+        static NodePtr RemoveMin(const NodePtr& node, NodePtr* min);
+        static NodePtr RemoveAux(const NodePtr& node, const keyT& key, bool* changed);
+        static const Node* FindNode(const Node* node, const keyT& target);
+        template <class Iterator>
+        static NodePtr Build(Iterator& it, int n);
+        void Publish(NodePtr newRoot);
+
+    public:
+        class Version;
+
+        PersistentBST() : root(nullptr) {}
+        //Builds from size entries in increasing key order; *begin must expose key and data.
+        template <class Iterator>
+        PersistentBST(Iterator begin, int size) : root(Build(begin, size)) {}
+        PersistentBST(const PersistentBST<keyT, dataT>& copy) : root(std::atomic_load(&copy.root)) {}
+        PersistentBST<keyT, dataT>& operator=(const PersistentBST<keyT, dataT>& copy);
+        ~PersistentBST() = default;
+
+        void Insert(const keyT& key, const std::shared_ptr<dataT>& data);
+        void InsertOrAssign(const keyT& key, const std::shared_ptr<dataT>& data);
+        void Remove(const keyT& key);
+        std::shared_ptr<dataT> Get(const keyT& target) const;
+        bool Find(const keyT& target) const;
+        int Size() const;
+        Version Snapshot() const;
+};
+
+template <class keyT, class dataT>
+class PersistentBST<keyT, dataT>::Version {
+    private:
+        NodePtr root;
+
+        explicit Version(NodePtr root) : root(std::move(root)) {}
+        friend class PersistentBST<keyT, dataT>;
+
+    public:
+        std::shared_ptr<dataT> Get(const keyT& target) const;
+        bool Find(const keyT& target) const;
+        int Size() const {
+            return GetCount(root);
+        }
+        template <class Function>
+        void ForEachInRange(const keyT& lo, const keyT& hi, Function fn) const;
+};
+
+template <class keyT, class dataT>
+PersistentBST<keyT, dataT>::Node::Node(const keyT& key, const std::shared_ptr<dataT>& data, NodePtr left, NodePtr right) :
+    key(key), data(data), left(std::move(left)), right(std::move(right))
+{
+    int leftHeight = GetHeight(this->left);
+    int rightHeight = GetHeight(this->right);
+    height = (leftHeight > rightHeight ? leftHeight : rightHeight) + 1;
+    count = GetCount(this->left) + GetCount(this->right) + 1;
+}
+
+template <class keyT, class dataT>
+PersistentBST<keyT, dataT>& PersistentBST<keyT, dataT>::operator=(const PersistentBST<keyT, dataT>& copy)
+{
+    if (this != &copy)
+        this->Publish(std::atomic_load(&copy.root));
+    return *this;
+}
+
+template <class keyT, class dataT>
+void PersistentBST<keyT, dataT>::Publish(NodePtr newRoot)
+{
+    std::atomic_store(&this->root, std::move(newRoot));
+}
+
+template <class keyT, class dataT>
+typename PersistentBST<keyT, dataT>::NodePtr PersistentBST<keyT, dataT>::Make(const keyT& key, const std::shared_ptr<dataT>& data,
+                                                                              NodePtr left, NodePtr right)
+{
+    return std::make_shared<const Node>(key, data, std::move(left), std::move(right));
+}
+
+//Builds a node over two subtrees whose heights differ by at most two, rotating if needed.
+template <class keyT, class dataT>
+typename PersistentBST<keyT, dataT>::NodePtr PersistentBST<keyT, dataT>::Balance(const keyT& key, const std::shared_ptr<dataT>& data,
+                                                                                 NodePtr left, NodePtr right)
+{
+    int leftHeight = GetHeight(left);
+    int rightHeight = GetHeight(right);
+
+    if (leftHeight > rightHeight + 1) {
+        if (GetHeight(left->left) >= GetHeight(left->right))
+            return Make(left->key, left->data, left->left, Make(key, data, left->right, std::move(right)));
+        const NodePtr& middle = left->right;
+        return Make(middle->key, middle->data, Make(left->key, left->data, left->left, middle->left),
+                    Make(key, data, middle->right, std::move(right)));
+    }
+    if (rightHeight > leftHeight + 1) {
+        if (GetHeight(right->right) >= GetHeight(right->left))
+            return Make(right->key, right->data, Make(key, data, std::move(left), right->left), right->right);
+        const NodePtr& middle = right->left;
+        return Make(middle->key, middle->data, Make(key, data, std::move(left), middle->left),
+                    Make(right->key, right->data, middle->right, right->right));
+    }
+    return Make(key, data, std::move(left), std::move(right));
+}
+
+template <class keyT, class dataT>
+typename PersistentBST<keyT, dataT>::NodePtr PersistentBST<keyT, dataT>::InsertAux(const NodePtr& node, const keyT& key,
+                                                                                   const std::shared_ptr<dataT>& data, bool assign, bool* changed)
+{
+    if (node == nullptr) {
+        *changed = true;
+        return Make(key, data, nullptr, nullptr);
+    }
+
+    if (node->key == key) {
+        if (!assign)
+            return node;
+        *changed = true;
+        return Make(key, data, node->left, node->right);
+    }
+
+    if (node->key < key) {
+        NodePtr right = InsertAux(node->right, key, data, assign, changed);
+        if (!*changed)
+            return node;
+        return Balance(node->key, node->data, node->left, std::move(right));
+    }
+    NodePtr left = InsertAux(node->left, key, data, assign, changed);
+    if (!*changed)
+        return node;
+    return Balance(node->key, node->data, std::move(left), node->right);
+}
+
+template <class keyT, class dataT>
+typename PersistentBST<keyT, dataT>::NodePtr PersistentBST<keyT, dataT>::RemoveMin(const NodePtr& node, NodePtr* min)
+{
+    if (node->left == nullptr) {
+        *min = node;
+        return node->right;
+    }
+    return Balance(node->key, node->data, RemoveMin(node->left, min), node->right);
+}
+
+template <class keyT, class dataT>
+typename PersistentBST<keyT, dataT>::NodePtr PersistentBST<keyT, dataT>::RemoveAux(const NodePtr& node, const keyT& key, bool* changed)
+{
+    if (node == nullptr)
+        return nullptr;
+
+    if (node->key == key) {
+        *changed = true;
+        if (node->left == nullptr)
+            return node->right;
+        if (node->right == nullptr)
+            return node->left;
+        NodePtr min = nullptr;
+        NodePtr right = RemoveMin(node->right, &min);
+        return Balance(min->key, min->data, node->left, std::move(right));
+    }
+
+    if (node->key < key) {
+        NodePtr right = RemoveAux(node->right, key, changed);
+        if (!*changed)
+            return node;
+        return Balance(node->key, node->data, node->left, std::move(right));
+    }
+    NodePtr left = RemoveAux(node->left, key, changed);
+    if (!*changed)
+        return node;
+    return Balance(node->key, node->data, std::move(left), node->right);
+}
+
+template <class keyT, class dataT>
+void PersistentBST<keyT, dataT>::Insert(const keyT& key, const std::shared_ptr<dataT>& data)
+{
+    bool changed = false;
+    NodePtr newRoot = InsertAux(this->root, key, data, false, &changed);
+    if (changed)
+        this->Publish(std::move(newRoot));
+}
+
+template <class keyT, class dataT>
+void PersistentBST<keyT, dataT>::InsertOrAssign(const keyT& key, const std::shared_ptr<dataT>& data)
+{
+    bool changed = false;
+    this->Publish(InsertAux(this->root, key, data, true, &changed));
+}
+
+template <class keyT, class dataT>
+void PersistentBST<keyT, dataT>::Remove(const keyT& key)
+{
+    bool changed = false;
+    NodePtr newRoot = RemoveAux(this->root, key, &changed);
+    if (changed)
+        this->Publish(std::move(newRoot));
+}
+
+template <class keyT, class dataT>
+const typename PersistentBST<keyT, dataT>::Node* PersistentBST<keyT, dataT>::FindNode(const Node* node, const keyT& target)
+{
+    while (node != nullptr) {
+        if (node->key == target)
+            return node;
+        if (node->key < target)
+            node = node->right.get();
+        else
+            node = node->left.get();
+    }
+    return nullptr;
+}
+
+template <class keyT, class dataT>
+template <class Iterator>
+typename PersistentBST<keyT, dataT>::NodePtr PersistentBST<keyT, dataT>::Build(Iterator& it, int n)
+{
+    if (n <= 0)
+        return nullptr;
+    NodePtr left = Build(it, n / 2);
+    keyT key = it->key;
+    std::shared_ptr<dataT> data = it->data;
+    ++it;
+    NodePtr right = Build(it, n - n / 2 - 1);
+    return Make(key, data, std::move(left), std::move(right));
+}
+
+template <class keyT, class dataT>
+std::shared_ptr<dataT> PersistentBST<keyT, dataT>::Get(const keyT& target) const
+{
+    return this->Snapshot().Get(target);
+}
+
+template <class keyT, class dataT>
+bool PersistentBST<keyT, dataT>::Find(const keyT& target) const
+{
+    return this->Snapshot().Find(target);
+}
+
+template <class keyT, class dataT>
+int PersistentBST<keyT, dataT>::Size() const
+{
+    return this->Snapshot().Size();
+}
+
+template <class keyT, class dataT>
+typename PersistentBST<keyT, dataT>::Version PersistentBST<keyT, dataT>::Snapshot() const
+{
+    return Version(std::atomic_load(&this->root));
+}
+
+template <class keyT, class dataT>
+std::shared_ptr<dataT> PersistentBST<keyT, dataT>::Version::Get(const keyT& target) const
+{
+    const Node* node = FindNode(this->root.get(), target);
+    if (node == nullptr)
+        return nullptr;
+    return node->data;
+}
+
+template <class keyT, class dataT>
+bool PersistentBST<keyT, dataT>::Version::Find(const keyT& target) const
+{
+    return FindNode(this->root.get(), target) != nullptr;
+}
+
+template <class keyT, class dataT>
+template <class Function>
+void PersistentBST<keyT, dataT>::Version::ForEachInRange(const keyT& lo, const keyT& hi, Function fn) const
+{
+    const Node* path[MAX_DEPTH];
+    int depth = 0;
+    const Node* curr = this->root.get();
+    while (curr != nullptr) {
+        if (curr->key < lo)
+            curr = curr->right.get();
+        else {
+            path[depth++] = curr;
+            curr = curr->left.get();
+        }
+    }
+
+    while (depth > 0) {
+        const Node* node = path[--depth];
+        if (hi < node->key)
+            return;
+        fn(node->key, node->data);
+        for (curr = node->right.get(); curr != nullptr; curr = curr->left.get())
+            path[depth++] = curr;
+    }
+}
+
+#endif /* PERSISTENT_BST_H_ */
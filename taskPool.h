@@ -0,0 +1,196 @@
+#ifndef TASK_POOL_H_
+#define TASK_POOL_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+* TaskPool - a fork-join pool with one task deque per worker.
+* A worker pushes and pops tasks at the back of its own deque and steals from
+* the front of the others when it runs dry. A thread waiting for a forked task
+* keeps running queued tasks meanwhile, so nested Invoke calls never deadlock.
+* Threads outside the pool submit through a shared injection deque.
+*/
+class TaskPool {
+    private:
+        struct Task {
+            std::function<void()> fn;
+            std::atomic<bool> done;
+            std::exception_ptr error;
+
+            explicit Task(std::function<void()> fn) : fn(std::move(fn)), done(false), error(nullptr) {}
+        };
+
+        struct Queue {
+            std::mutex lock;
+            std::deque<Task*> tasks;
+        };
+
+        std::vector<std::thread> workers;
+        std::vector<Queue> queues;     //one per worker, the last one is the injection queue
+        std::atomic<int> queued;
+        std::atomic<bool> stop;
+        std::mutex sleepLock;
+        std::condition_variable wakeUp;
+
+        static int& WorkerIndex() {
+            static thread_local int index = -1;
+            return index;
+        }
+
+        static TaskPool*& CurrentPool() {
+            static thread_local TaskPool* pool = nullptr;
+            return pool;
+        }
+
+        int OwnQueue() const {
+            return CurrentPool() == this ? WorkerIndex() : (int)queues.size() - 1;
+        }
+
+        void Push(Task* task);
+        bool Reclaim(Task* task);
+        Task* Steal(int self);
+        static void Run(Task* task);
+        void WorkerLoop(int index);
+
+    public:
+        explicit TaskPool(int threads = (int)std::thread::hardware_concurrency());
+        TaskPool(const TaskPool& copy) = delete;
+        TaskPool& operator=(const TaskPool& copy) = delete;
+        ~TaskPool();
+
+        int Threads() const {
+            return (int)workers.size();
+        }
+
+        //Runs left on the calling thread and right on any worker, returns when both are done.
+        template <class Left, class Right>
+        void Invoke(Left left, Right right);
+};
+
+inline TaskPool::TaskPool(int threads) : queues(threads < 1 ? 2 : threads + 1), queued(0), stop(false) {
+    if (threads < 1)
+        threads = 1;
+    for (int i = 0; i < threads; i++)
+        workers.emplace_back(&TaskPool::WorkerLoop, this, i);
+}
+
+inline TaskPool::~TaskPool() {
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        stop = true;
+    }
+    wakeUp.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+inline void TaskPool::Push(Task* task) {
+    Queue& queue = queues[OwnQueue()];
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.push_back(task);
+    }
+    queued++;
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+    }
+    wakeUp.notify_one();
+}
+
+//Takes task back from the owner's deque if nobody has stolen it yet.
+inline bool TaskPool::Reclaim(Task* task) {
+    Queue& queue = queues[OwnQueue()];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.tasks.empty() || queue.tasks.back() != task)
+        return false;
+    queue.tasks.pop_back();
+    queued--;
+    return true;
+}
+
+inline TaskPool::Task* TaskPool::Steal(int self) {
+    int count = (int)queues.size();
+    for (int i = 0; i < count; i++) {
+        Queue& queue = queues[(self + i) % count];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (queue.tasks.empty())
+            continue;
+        Task* task;
+        if (i == 0) {
+            task = queue.tasks.back();
+            queue.tasks.pop_back();
+        }
+        else {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+        }
+        queued--;
+        return task;
+    }
+    return nullptr;
+}
+
+inline void TaskPool::Run(Task* task) {
+    try {
+        task->fn();
+    }
+    catch (...) {
+        task->error = std::current_exception();
+    }
+    task->done.store(true, std::memory_order_release);
+}
+
+inline void TaskPool::WorkerLoop(int index) {
+    WorkerIndex() = index;
+    CurrentPool() = this;
+    while (true) {
+        Task* task = Steal(index);
+        if (task != nullptr) {
+            Run(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(sleepLock);
+        if (stop)
+            return;
+        wakeUp.wait_for(guard, std::chrono::milliseconds(1), [this] { return stop || queued > 0; });
+    }
+}
+
+template <class Left, class Right>
+void TaskPool::Invoke(Left left, Right right) {
+    Task task{std::function<void()>(right)};
+    Push(&task);
+
+    std::exception_ptr error = nullptr;
+    try {
+        left();
+    }
+    catch (...) {
+        error = std::current_exception();
+    }
+
+    if (Reclaim(&task))
+        Run(&task);
+    while (!task.done.load(std::memory_order_acquire)) {
+        Task* other = Steal(OwnQueue());
+        if (other != nullptr)
+            Run(other);
+        else
+            std::this_thread::yield();
+    }
+
+    if (error != nullptr)
+        std::rethrow_exception(error);
+    if (task.error != nullptr)
+        std::rethrow_exception(task.error);
+}
+
+#endif /* TASK_POOL_H_ */
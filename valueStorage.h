@@ -0,0 +1,84 @@
+#ifndef VALUE_STORAGE_H_
+#define VALUE_STORAGE_H_
+
+#include <memory>
+#include <optional>
+#include <utility>
+
+/*
+* Value storage policies for the keyed containers (BST, HashTable).
+* A policy names three types for a value type T:
+*     Stored<T> - what a node holds, and what Insert takes
+*     Handle<T> - what Get returns; compares equal to nullptr when the key is absent
+*     Taken<T>  - what Extract returns; empty when the key is absent
+*
+* SharedValuePolicy - every value is its own std::shared_ptr allocation, and
+*                     lookups hand out a new reference to it.
+* InlineValuePolicy - the value lives inside the node. Get returns a raw
+*                     pointer to it, valid until the key is removed or the
+*                     container is changed structurally.
+*/
+struct SharedValuePolicy {
+    template <class T> using Stored = std::shared_ptr<T>;
+    template <class T> using Handle = std::shared_ptr<T>;
+    template <class T> using Taken = std::shared_ptr<T>;
+
+    template <class T, class... Args>
+    static std::shared_ptr<T> Make(Args&&... args) {
+        return std::make_shared<T>(std::forward<Args>(args)...);
+    }
+
+    template <class T>
+    static std::shared_ptr<T> Ref(const std::shared_ptr<T>& value) {
+        return value;
+    }
+
+    template <class T>
+    static const T* Address(const std::shared_ptr<T>& value) {
+        return value.get();
+    }
+
+    template <class T>
+    static T& Deref(const std::shared_ptr<T>& value) {
+        return *value;
+    }
+
+    template <class T>
+    static std::shared_ptr<T> Take(std::shared_ptr<T>& value) {
+        return std::move(value);
+    }
+};
+
+struct InlineValuePolicy {
+    template <class T> using Stored = T;
+    template <class T> using Handle = T*;
+    template <class T> using Taken = std::optional<T>;
+
+    template <class T, class... Args>
+    static T Make(Args&&... args) {
+        return T(std::forward<Args>(args)...);
+    }
+
+    //Like a shared_ptr handed out by a const container, the value itself stays mutable.
+    template <class T>
+    static T* Ref(const T& value) {
+        return const_cast<T*>(&value);
+    }
+
+    template <class T>
+    static const T* Address(const T& value) {
+        return &value;
+    }
+
+    template <class T>
+    static T& Deref(const T& value) {
+        return const_cast<T&>(value);
+    }
+
+    template <class T>
+    static std::optional<T> Take(T& value) {
+        return std::optional<T>(std::move(value));
+    }
+};
+
+#endif /* VALUE_STORAGE_H_ */